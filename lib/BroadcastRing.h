@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "CacheAligned.h"
+
+namespace buff {
+
+    // Кольцо с одним писателем и фиксированным числом читателей, каждый из которых видит все элементы.
+    // Писатель переиспользует слот только после того, как его прошел самый медленный читатель.
+    // Писатель и каждый читатель могут работать в своих потоках.
+    template<class T, class Allocator = std::allocator<T>>
+    class BroadcastRing {
+    public:
+        typedef T value_type;
+        typedef value_type *pointer;
+        typedef const value_type *const_pointer;
+        typedef size_t size_type;
+
+        BroadcastRing(size_t capacity, size_t consumers) : capacity_(capacity), consumers_(consumers),
+                                                            cursors_(new CacheLinePadded<std::atomic<uint64_t>>[consumers]()) {
+            mass = std::allocator_traits<Allocator>::allocate(allocator_, capacity_);
+        }
+
+        BroadcastRing(const BroadcastRing &) = delete;
+
+        BroadcastRing &operator=(const BroadcastRing &) = delete;
+
+        ~BroadcastRing() {
+            uint64_t head = head_.load(std::memory_order_relaxed);
+            uint64_t from = head > capacity_ ? head - capacity_ : 0;
+            if (reserved_ and head >= capacity_) {
+                ++from; // элемент в зарезервированном слоте уже разрушен
+            }
+            for (uint64_t seq = from; seq < head; seq++) {
+                std::allocator_traits<Allocator>::destroy(allocator_, mass + seq % capacity_);
+            }
+            std::allocator_traits<Allocator>::deallocate(allocator_, mass, capacity_);
+        }
+
+        size_t capacity() const {
+            return capacity_;
+        }
+
+        size_t consumers() const {
+            return consumers_;
+        }
+
+        // Повторный вызов до commit() возвращает тот же слот
+        pointer reserve_slot() {
+            if (capacity_ == 0) {
+                return nullptr;
+            }
+            uint64_t head = head_.load(std::memory_order_relaxed);
+            if (head - slowest_ >= capacity_) {
+                slowest_ = slowest_cursor(head);
+                if (head - slowest_ >= capacity_) {
+                    return nullptr;
+                }
+            }
+            pointer slot = mass + head % capacity_;
+            if (head >= capacity_ and !reserved_) {
+                std::allocator_traits<Allocator>::destroy(allocator_, slot);
+            }
+            reserved_ = true;
+            return slot;
+        }
+
+        void commit() {
+            reserved_ = false;
+            head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool try_put(const T &value) {
+            pointer slot = reserve_slot();
+            if (slot == nullptr) {
+                return false;
+            }
+            std::allocator_traits<Allocator>::construct(allocator_, slot, value);
+            commit();
+            return true;
+        }
+
+        const_pointer peek(size_t consumer) const {
+            uint64_t cursor = cursors_[consumer].value.load(std::memory_order_relaxed);
+            if (cursor == head_.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            return mass + cursor % capacity_;
+        }
+
+        // Без непрочитанных элементов ничего не делает, как release(n) буферов
+        void release(size_t consumer) {
+            std::atomic<uint64_t> &cursor = cursors_[consumer].value;
+            uint64_t current = cursor.load(std::memory_order_relaxed);
+            if (current == head_.load(std::memory_order_acquire)) {
+                return;
+            }
+            cursor.store(current + 1, std::memory_order_release);
+        }
+
+        bool try_get(size_t consumer, T &value) {
+            const_pointer slot = peek(consumer);
+            if (slot == nullptr) {
+                return false;
+            }
+            value = *slot;
+            release(consumer);
+            return true;
+        }
+
+        // Число элементов, которые читатель consumer еще не прочитал
+        size_t size(size_t consumer) const {
+            return head_.load(std::memory_order_acquire) - cursors_[consumer].value.load(std::memory_order_relaxed);
+        }
+
+    private:
+        T *mass;
+        size_t capacity_;
+        size_t consumers_;
+        Allocator allocator_;
+        std::unique_ptr<CacheLinePadded<std::atomic<uint64_t>>[]> cursors_;
+        uint64_t slowest_ = 0;
+        bool reserved_ = false;
+        alignas(kCacheLineSize) std::atomic<uint64_t> head_{0};
+
+        uint64_t slowest_cursor(uint64_t head) const {
+            uint64_t slowest = head;
+            for (size_t i = 0; i < consumers_; i++) {
+                uint64_t cursor = cursors_[i].value.load(std::memory_order_acquire);
+                if (cursor < slowest) {
+                    slowest = cursor;
+                }
+            }
+            return slowest;
+        }
+    };
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef BUFF_ENABLE_STATS
+#include <atomic>
+
+#include "CacheAligned.h"
+#endif
+
+namespace buff {
+
+    constexpr size_t kOccupancyBuckets = 8;
+
+    struct BufferStatsSnapshot {
+        uint64_t puts = 0;
+        uint64_t gets = 0;
+        uint64_t empty_gets = 0;
+        uint64_t overwrites = 0;
+        uint64_t reallocations = 0;
+        uint64_t high_water_mark = 0;
+        // occupancy[i] - число put, после которых буфер заполнен на (i / kOccupancyBuckets, (i + 1) / kOccupancyBuckets]
+        uint64_t occupancy[kOccupancyBuckets] = {};
+    };
+
+    class NoStats {
+    public:
+        constexpr void on_put(size_t, size_t, size_t = 1) {}
+
+        constexpr void on_get(size_t) {}
+
+        constexpr void on_empty_get() {}
+
+        constexpr void on_overwrite() {}
+
+        constexpr void on_reallocation() {}
+
+        constexpr BufferStatsSnapshot snapshot() const {
+            return BufferStatsSnapshot();
+        }
+    };
+
+#ifdef BUFF_ENABLE_STATS
+
+    class AtomicStats {
+    public:
+        AtomicStats() = default;
+
+        AtomicStats(const AtomicStats &) = delete;
+
+        AtomicStats &operator=(const AtomicStats &) = delete;
+
+        void on_put(size_t size, size_t capacity, size_t count = 1) {
+            puts_.fetch_add(count, std::memory_order_relaxed);
+            if (size > high_water_mark_.load(std::memory_order_relaxed)) {
+                high_water_mark_.store(size, std::memory_order_relaxed);
+            }
+            if (capacity != 0 and size != 0) {
+                occupancy_[(size * kOccupancyBuckets - 1) / capacity].fetch_add(count, std::memory_order_relaxed);
+            }
+        }
+
+        void on_get(size_t n) {
+            gets_.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        void on_empty_get() {
+            empty_gets_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void on_overwrite() {
+            overwrites_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void on_reallocation() {
+            reallocations_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        BufferStatsSnapshot snapshot() const {
+            BufferStatsSnapshot ret;
+            ret.puts = puts_.load(std::memory_order_relaxed);
+            ret.gets = gets_.load(std::memory_order_relaxed);
+            ret.empty_gets = empty_gets_.load(std::memory_order_relaxed);
+            ret.overwrites = overwrites_.load(std::memory_order_relaxed);
+            ret.reallocations = reallocations_.load(std::memory_order_relaxed);
+            ret.high_water_mark = high_water_mark_.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < kOccupancyBuckets; i++) {
+                ret.occupancy[i] = occupancy_[i].load(std::memory_order_relaxed);
+            }
+            return ret;
+        }
+
+    private:
+        std::atomic<uint64_t> puts_{0};
+        std::atomic<uint64_t> overwrites_{0};
+        std::atomic<uint64_t> reallocations_{0};
+        std::atomic<uint64_t> high_water_mark_{0};
+        std::atomic<uint64_t> occupancy_[kOccupancyBuckets] = {};
+        // счетчики читателя - на своей линии, чтобы get не трогал линии писателя
+        BUFF_CACHE_ALIGNED std::atomic<uint64_t> gets_{0};
+        std::atomic<uint64_t> empty_gets_{0};
+    };
+
+    typedef AtomicStats BufferStats;
+#else
+    typedef NoStats BufferStats;
+#endif
+}
@@ -1,295 +1,182 @@
 #pragma once
 
-#include <iostream>
+#include <cstdint>
+#include <cstring>
 #include <memory>
-#include <limits>
+#include <new>
 #include <iterator>
+#include <type_traits>
+#include <utility>
+
+#if __has_include(<sys/uio.h>)
+#define BUFF_HAS_UIO 1
+#include <cerrno>
+#include <sys/uio.h>
+#endif
+
+#include "CCircularBufferFwd.h"
+#include "BufferStats.h"
+#include "CacheAligned.h"
+#include "LatencyTrace.h"
+#include "RingIndex.h"
 
 namespace buff {
 
-    template<class T, class Allocator= std::allocator<T>>
-    class CCircularBufferBase;
+    namespace detail {
+        // Заголовок образа, который пишет save(); формат платформенно-зависимый (порядок байт, sizeof(T))
+        struct ImageHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t element_size;
+            uint64_t capacity;
+            uint64_t size;
+        };
 
-    template<class T, class Allocator = std::allocator<T>>
-    class Iterator;
+        constexpr uint32_t kImageMagic = 0x46465542; // "BUFF"
+        constexpr uint32_t kImageVersion = 1;
 
-    template<class T, class Allocator=std::allocator<T>>
-    class ConstIterator;
+        // memcpy и memcmp нельзя вызывать при вычислении на этапе компиляции
+        constexpr bool bulk_ops_allowed() {
+#ifdef __cpp_lib_is_constant_evaluated
+            return !std::is_constant_evaluated();
+#else
+            return true;
+#endif
+        }
+    }
 
-    template<class T, class Allocator>
-    class Iterator {
+    template<class T>
+    struct Segment {
+        T *data;
+        size_t size;
+
+        BUFF_CONSTEXPR20 T *begin() const {
+            return data;
+        }
+
+        BUFF_CONSTEXPR20 T *end() const {
+            return data + size;
+        }
+    };
+
+    // Итератор произвольного доступа по буферу; Const = true - const_iterator. Iterator приводится
+    // к ConstIterator, обратного преобразования нет.
+    template<class T, class Allocator, bool Const>
+    class RingIterator {
         friend CCircularBufferBase<T, Allocator>;
-        friend ConstIterator<T, Allocator>;
+        friend RingIterator<T, Allocator, !Const>;
     public:
         typedef ptrdiff_t difference_type;
         typedef T value_type;
-        typedef T *pointer;
-        typedef T &reference;
+        typedef typename std::conditional<Const, const T *, T *>::type pointer;
+        typedef typename std::conditional<Const, const T &, T &>::type reference;
         typedef size_t size_type;
         typedef std::random_access_iterator_tag iterator_category;
 
-        difference_type operator-(const Iterator &lhs) const {
-            if (array != lhs.array) {
-                return array + index - lhs.array - lhs.index;
-            }
-            if (index == lhs.index) {
-                if (is_begin == lhs.is_begin) {
-                    return 0;
-                }
-                if (!is_begin and lhs.is_begin) {
-                    return get_size();
-                }
-                if (is_begin and !lhs.is_begin) {
-                    return -get_size();
-                }
-            }
-            if (index == end_index) {
-                size_t pred_ind = end_index;
-                if (pred_ind == 0) {
-                    pred_ind = capacity_;
-                }
-                --pred_ind;
-                return Iterator(capacity_, array, begin_index, end_index, pred_ind, is_empty, true) - lhs + 1;
-            }
-            if (index >= begin_index and lhs.index >= begin_index) {
-                if (index == lhs.index and begin_index == index and begin_index == end_index) {
-                    if (!is_begin and lhs.is_begin) {
-                        return get_size();
-                    }
-                    if (is_begin and !lhs.is_begin) {
-                        return -get_size();
-                    }
-                    return 0;
-                }
-                return index - lhs.index;
-            }
-            if (index >= begin_index) {
-                return -(lhs.index + capacity_ - index);
-            }
-
-            return (index + capacity_ - lhs.index);
-        }
+        BUFF_CONSTEXPR20 RingIterator() = default;
 
-        bool operator==(const Iterator &lhs) {
-            if ((array + index) == (lhs.array + lhs.index)) {
-                if (begin_index == end_index and index == end_index) {
-                    return is_begin == lhs.is_begin;
-                }
-
-                return true;
-            }
+        template<bool OtherConst, class = typename std::enable_if<Const and !OtherConst>::type>
+        BUFF_CONSTEXPR20 RingIterator(const RingIterator<T, Allocator, OtherConst> &other) : array(other.array),
+                                                                                           capacity_(other.capacity_),
+                                                                                           begin_index(other.begin_index),
+                                                                                           pos_(other.pos_) {}
 
-            return false;
+        BUFF_CONSTEXPR20 friend difference_type operator-(const RingIterator &rhs, const RingIterator &lhs) {
+            return static_cast<difference_type>(rhs.pos_) - static_cast<difference_type>(lhs.pos_);
         }
 
-        bool operator!=(const Iterator &lhs) {
-            return !(*this == lhs);
+        BUFF_CONSTEXPR20 friend bool operator==(const RingIterator &rhs, const RingIterator &lhs) {
+            return rhs.array == lhs.array and rhs.pos_ == lhs.pos_;
         }
 
-        bool operator<(const Iterator &lhs) {
-            return ((lhs - *this) > 0);
+        BUFF_CONSTEXPR20 friend bool operator!=(const RingIterator &rhs, const RingIterator &lhs) {
+            return !(rhs == lhs);
         }
 
-        bool operator>(const Iterator &lhs) {
-            return ((*this - lhs) > 0);
+        BUFF_CONSTEXPR20 friend bool operator<(const RingIterator &rhs, const RingIterator &lhs) {
+            return rhs.pos_ < lhs.pos_;
         }
 
-        bool operator>=(const Iterator &lhs) {
-            return !(*this < lhs);
+        BUFF_CONSTEXPR20 friend bool operator>(const RingIterator &rhs, const RingIterator &lhs) {
+            return lhs < rhs;
         }
 
-        bool operator<=(const Iterator &lhs) {
-            return !(*this > lhs);
+        BUFF_CONSTEXPR20 friend bool operator>=(const RingIterator &rhs, const RingIterator &lhs) {
+            return !(rhs < lhs);
         }
 
-        reference operator->() {
-            return *(array + index);
+        BUFF_CONSTEXPR20 friend bool operator<=(const RingIterator &rhs, const RingIterator &lhs) {
+            return !(lhs < rhs);
         }
 
-        virtual reference operator*() {
-            return *(array + index);
+        BUFF_CONSTEXPR20 pointer operator->() const {
+            return array + detail::ring_index(begin_index, pos_, capacity_);
         }
 
-        Iterator &operator++() {
-            if (is_empty or capacity_ == 0) {
-                return *this;
-            }
-            index = (index + 1) % capacity_;
-            if (index == end_index) {
-                is_begin = !is_begin;
-            }
-            return *this;
+        BUFF_CONSTEXPR20 reference operator*() const {
+            return array[detail::ring_index(begin_index, pos_, capacity_)];
         }
 
-        Iterator operator++(int) {
-            if (is_empty or capacity_ == 0) {
-                return *this;
-            }
-            Iterator old_value(capacity_, array, begin_index, end_index, index, is_empty);
-            ++(*this);
-            return old_value;
+        BUFF_CONSTEXPR20 reference operator[](difference_type idx) const {
+            return *(*this + idx);
         }
 
-        Iterator &operator--() {
-            if (is_empty or capacity_ == 0) {
-                return *this;
-            }
-            if (index == begin_index and is_begin) {
-                is_begin = !is_begin;
-                return *this;
-            }
-
-            if (begin_index == end_index) {
-                if (index == 0) {
-                    index = capacity_ - 1;
-                } else {
-                    index--;
-                }
-
-                if (index == begin_index) {
-                    is_begin = true;
-                    return *this;
-                }
-
-            } else if (begin_index > end_index) {
-                if (index == 0) {
-                    index = capacity_ - 1;
-                } else if (index == begin_index) {
-                    index = end_index;
-                } else {
-                    index--;
-                }
-            } else {
-                index--;
-                if (index < begin_index) {
-                    index = end_index;
-                }
-            }
-            if (index == end_index) {
-                is_begin = !is_begin;
-            }
+        BUFF_CONSTEXPR20 RingIterator &operator++() {
+            ++pos_;
             return *this;
         }
 
-        Iterator operator--(int) {
-            if (is_empty) {
-                return *this;
-            }
-            Iterator old_value(capacity_, array, begin_index, end_index, index, is_empty);
-            --(*this);
+        BUFF_CONSTEXPR20 RingIterator operator++(int) {
+            RingIterator old_value(*this);
+            ++pos_;
             return old_value;
         }
 
-        Iterator &operator+=(difference_type diff) {
-            if (is_empty or capacity_ == 0) {
-                return *this;
-            }
-            if (diff == 0) {
-                return *this;
-            }
-            diff = diff % get_size();
-            if (diff == 0) {
-                if (index == end_index and begin_index == end_index) {
-                    is_begin = false;
-                }
-                return *this;
-            }
-
-            index = (index + diff) % capacity_;
-            if (index > end_index and index < begin_index) {
-                index = (begin_index - end_index + index - 1) % capacity_;
-            }
-
-            if (index == end_index and end_index == begin_index) {
-                is_begin = !is_begin;
-            }
+        BUFF_CONSTEXPR20 RingIterator &operator--() {
+            --pos_;
             return *this;
         }
 
-        Iterator operator+(difference_type lhs) const {
-            return Iterator<T>(capacity_, array, begin_index, end_index, index, is_empty, is_begin) += lhs;
-        }
-
-        Iterator &operator-=(difference_type lhs) {
-            return *this += -lhs;
+        BUFF_CONSTEXPR20 RingIterator operator--(int) {
+            RingIterator old_value(*this);
+            --pos_;
+            return old_value;
         }
 
-        virtual reference operator[](difference_type idx) const {
-            Iterator old_value(capacity_, array, begin_index, end_index, index, is_empty, is_begin);
-            old_value += idx;
-            return *old_value;
+        BUFF_CONSTEXPR20 RingIterator &operator+=(difference_type diff) {
+            pos_ += diff;
+            return *this;
         }
 
-        Iterator &operator=(const Iterator &other) {
-            array = other.array;
-            capacity_ = other.capacity_;
-            end_index = other.end_index;
-            begin_index = other.begin_index;
-            is_empty = other.is_empty;
-            index = other.index;
+        BUFF_CONSTEXPR20 RingIterator &operator-=(difference_type diff) {
+            pos_ -= diff;
             return *this;
         }
 
-    protected:
-        Iterator() = default;
-
-        size_t capacity_;
-        size_t end_index;
-        size_t begin_index;
-        size_t index;
-        bool is_empty;
-        pointer array;
-        bool is_begin = true;
-
-        difference_type get_size() const {
-            if (end_index > begin_index) {
-                return end_index - begin_index;
-            } else if (end_index < begin_index) {
-                return capacity_ - begin_index + end_index;
-            } else if (is_empty) {
-                return 0;
-            } else {
-                return capacity_;
-            }
+        BUFF_CONSTEXPR20 RingIterator operator+(difference_type diff) const {
+            RingIterator ret(*this);
+            return ret += diff;
         }
 
-        Iterator(size_t capacity, T *ptr, size_t beg, size_t end, size_t ind, bool empty, bool isBeg) : capacity_(
-                capacity),
-                                                                                                        array(ptr),
-                                                                                                        index(ind),
-                                                                                                        begin_index(
-                                                                                                                beg),
-                                                                                                        end_index(end),
-                                                                                                        is_empty(
-                                                                                                                empty) {
-            if (!is_empty and begin_index == end_index) {
-                is_begin = isBeg;
-            }
-        };
-    };
-
-    template<class T, class Allocator>
-    class ConstIterator : public Iterator<T, Allocator> {
-        friend CCircularBufferBase<T, Allocator>;
-    public:
-        typedef ptrdiff_t difference_type;
-        typedef T &reference;
-
-        reference operator*() const {
-            return *(this->array + this->index);
+        BUFF_CONSTEXPR20 RingIterator operator-(difference_type diff) const {
+            RingIterator ret(*this);
+            return ret -= diff;
         }
 
-        reference operator[](difference_type idx) const {
-            Iterator<T, Allocator> old_value(this->capacity_, this->array, this->begin_index, this->end_index, this->begin_index,
-                               this->is_empty,
-                               this->is_begin);
-            return old_value[idx];
+        BUFF_CONSTEXPR20 friend RingIterator operator+(difference_type diff, const RingIterator &it) {
+            return it + diff;
         }
 
-    protected:
-        ConstIterator(size_t capacity, T *ptr, size_t beg, size_t end, size_t ind, bool empty, bool isBeg)
-                : Iterator<T, Allocator>(
-                capacity, ptr, beg, end, ind, empty, isBeg) {}
+    private:
+        pointer array = nullptr;
+        size_t capacity_ = 0;
+        size_t begin_index = 0;
+        size_t pos_ = 0;
+
+        BUFF_CONSTEXPR20 RingIterator(pointer ptr, size_t capacity, size_t beg, size_t pos) : array(ptr),
+                                                                                              capacity_(capacity),
+                                                                                              begin_index(beg),
+                                                                                              pos_(pos) {}
     };
 
     template<class T, class Allocator>
@@ -297,25 +184,22 @@ namespace buff {
     public:
         typedef T value_type;
         typedef value_type *pointer;
-        typedef ConstIterator<T> const_iterator;
+        typedef const value_type *const_pointer;
+        typedef value_type &reference;
+        typedef const value_type &const_reference;
+        typedef Iterator<T, Allocator> iterator;
+        typedef ConstIterator<T, Allocator> const_iterator;
         typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
-        typedef std::reverse_iterator<Iterator<T>> reverse_iterator;
+        typedef std::reverse_iterator<iterator> reverse_iterator;
         typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
 
-        size_t size() const {
-            if (end_index > beg_index) {
-                return end_index - beg_index;
-            } else if (end_index < beg_index) {
-                return capacity_ - beg_index + end_index;
-            } else if (empty_) {
-                return 0;
-            } else {
-                return capacity_;
-            }
+        BUFF_CONSTEXPR20 size_t size() const {
+            return detail::ring_size(beg_index, end_index, capacity_, empty_);
         }
 
-        void reserve(size_type new_cap) {
-            if (new_cap > allocator_.max_size()) {
+        BUFF_CONSTEXPR20 void reserve(size_type new_cap) {
+            if (new_cap > std::allocator_traits<Allocator>::max_size(allocator_)) {
                 return;
             }
             if (new_cap <= capacity_) {
@@ -323,40 +207,38 @@ namespace buff {
             }
             size_t sizes = size();
             size_t old_cap = capacity_;
-            capacity_ = new_cap;
-            T *mass2 = std::allocator_traits<Allocator>::allocate(allocator_, capacity_);
+            uint64_t old_beg = beg_index;
+            T *mass2 = std::allocator_traits<Allocator>::allocate(allocator_, new_cap);
 
-            for (uint64_t i = 0; i < sizes; i++) {
-                std::allocator_traits<Allocator>::construct(allocator_, mass2 + i, (*this)[i]);
+            std::pair<Segment<T>, Segment<T>> source = segments();
+            construct_segments<true>(mass2, source);
+            for (T &value: source.first) {
+                std::allocator_traits<Allocator>::destroy(allocator_, &value);
+            }
+            for (T &value: source.second) {
+                std::allocator_traits<Allocator>::destroy(allocator_, &value);
+            }
+            if (old_cap != 0) {
+                std::allocator_traits<Allocator>::deallocate(allocator_, mass, old_cap);
             }
 
-            pointer temp = mass;
-            uint64_t old_beg = beg_index;
             mass = mass2;
+            capacity_ = new_cap;
+            stats_.on_reallocation();
+            trace_.relocate(old_beg, sizes, old_cap, new_cap);
             beg_index = 0;
             end_index = sizes;
-            if (end_index == new_cap) {
-                end_index = 0;
-            }
-
-            if (old_cap != 0) {
-                for (uint64_t i = 0; i < sizes; i++) {
-                    std::allocator_traits<Allocator>::destroy(allocator_, temp + old_beg);
-                    old_beg = (old_beg + 1) % old_cap;
-                }
-                std::allocator_traits<Allocator>::deallocate(allocator_, temp, old_cap);
-            }
         }
 
-        size_t capacity() const {
+        BUFF_CONSTEXPR20 size_t capacity() const {
             return capacity_;
         }
 
-        bool empty() const {
+        BUFF_CONSTEXPR20 bool empty() const {
             return empty_;
         }
 
-        void clear() {
+        BUFF_CONSTEXPR20 void clear() {
             uint64_t j = beg_index;
             for (uint64_t i = 0; i < size(); i++) {
                 std::allocator_traits<Allocator>::destroy(allocator_, mass + j);
@@ -367,135 +249,343 @@ namespace buff {
             empty_ = true;
         }
 
-        T get() {
-            T ret;
+        BUFF_CONSTEXPR20 T get() {
+            T ret = T();
             if (empty_) {
+                stats_.on_empty_get();
                 return ret;
             }
             ret = this->front();
-            std::allocator_traits<Allocator>::destroy(allocator_, mass + beg_index);
-            beg_index = (beg_index + 1) % capacity_;
-            if (beg_index == end_index) {
-                empty_ = true;
+            release(1);
+            return ret;
+        }
+
+        BUFF_CONSTEXPR20 void commit() {
+            if (capacity_ == 0) {
+                return;
+            }
+            trace_.stamp(end_index);
+            end_index = detail::next_index(end_index, capacity_);
+            if (empty_) {
+                empty_ = false; // пишем только при переходе, empty_ на линии читателя
+            }
+            stats_.on_put(size(), capacity_);
+        }
+
+#ifdef BUFF_HAS_UIO
+        // Читает из fd в свободное место (до двух сегментов за один readv), результат - как у readv.
+        // Если свободного места нет, возвращает -1 с errno = ENOBUFS.
+        ssize_t read_from_fd(int fd) {
+            static_assert(sizeof(T) == 1 and std::is_trivially_copyable<T>::value, "byte buffers only");
+            size_t used = size();
+            if (used == capacity_) {
+                errno = ENOBUFS;
+                return -1;
+            }
+            std::pair<Segment<T>, Segment<T>> free = range(mass, used, capacity_ - used);
+            iovec iov[2] = {{free.first.data, free.first.size}, {free.second.data, free.second.size}};
+            ssize_t ret = readv(fd, iov, free.second.size == 0 ? 1 : 2);
+            if (ret > 0) {
+                advance_end(ret);
             }
             return ret;
         }
 
-        Iterator<value_type> begin() {
-            return Iterator<value_type, Allocator>(capacity_, mass, beg_index, end_index, beg_index, empty_, true);
+        // Пишет в fd содержимое буфера (до двух сегментов за один writev) и убирает записанное
+        ssize_t write_to_fd(int fd) {
+            static_assert(sizeof(T) == 1 and std::is_trivially_copyable<T>::value, "byte buffers only");
+            if (empty_) {
+                return 0;
+            }
+            std::pair<Segment<T>, Segment<T>> filled = segments();
+            iovec iov[2] = {{filled.first.data, filled.first.size}, {filled.second.data, filled.second.size}};
+            ssize_t ret = writev(fd, iov, filled.second.size == 0 ? 1 : 2);
+            if (ret > 0) {
+                release(ret);
+            }
+            return ret;
+        }
+#endif
+
+        // Пишет в поток заголовок и элементы по сегментам, не более двух записей на данные. Подходит
+        // std::ostream или любой класс с write(const char *, n) и приведением к bool, сообщающим об ошибке.
+        template<class OStream>
+        bool save(OStream &out) const {
+            static_assert(std::is_trivially_copyable<T>::value, "save needs trivially copyable T");
+            detail::ImageHeader header = {detail::kImageMagic, detail::kImageVersion, sizeof(T), capacity_, size()};
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            std::pair<Segment<const T>, Segment<const T>> filled = segments();
+            if (filled.first.size != 0) {
+                out.write(reinterpret_cast<const char *>(filled.first.data), filled.first.size * sizeof(T));
+            }
+            if (filled.second.size != 0) {
+                out.write(reinterpret_cast<const char *>(filled.second.data), filled.second.size * sizeof(T));
+            }
+            return static_cast<bool>(out);
+        }
+
+        // Читает образ, записанный save(): емкость становится сохраненной, элементы одним чтением ложатся
+        // в mass с нулевого слота. Если заголовок негоден или под его емкость не хватило памяти, возвращает
+        // false и не меняет буфер; если оборвались сами элементы - false и буфер пуст. Подходит std::istream
+        // или любой класс, у которого read(char *, n) возвращает приводимое к bool значение.
+        template<class IStream>
+        bool load(IStream &in) {
+            static_assert(std::is_trivially_copyable<T>::value, "load needs trivially copyable T");
+            detail::ImageHeader header;
+            if (!in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+                return false;
+            }
+            if (header.magic != detail::kImageMagic or header.version != detail::kImageVersion or
+                header.element_size != sizeof(T) or header.size > header.capacity or
+                header.capacity > std::allocator_traits<Allocator>::max_size(allocator_)) {
+                return false;
+            }
+            if (header.capacity != capacity_) {
+                // новая память берется до освобождения старой, чтобы при bad_alloc буфер остался целым
+                T *mass2;
+                try {
+                    mass2 = std::allocator_traits<Allocator>::allocate(allocator_, header.capacity);
+                } catch (const std::bad_alloc &) {
+                    return false;
+                }
+                try {
+                    trace_.resize(header.capacity);
+                } catch (const std::bad_alloc &) {
+                    std::allocator_traits<Allocator>::deallocate(allocator_, mass2, header.capacity);
+                    return false;
+                }
+                clear();
+                if (capacity_ > 0) {
+                    std::allocator_traits<Allocator>::deallocate(allocator_, mass, capacity_);
+                }
+                mass = mass2;
+                capacity_ = header.capacity;
+            } else {
+                clear();
+                trace_.resize(capacity_); // старые метки к загруженным элементам не относятся
+            }
+            if (header.size == 0) {
+                return true;
+            }
+            if (!in.read(reinterpret_cast<char *>(mass), header.size * sizeof(T))) {
+                return false;
+            }
+            end_index = detail::ring_index(0, header.size, capacity_);
+            empty_ = false;
+            return true;
+        }
+
+        BUFF_CONSTEXPR20 const T *peek() const {
+            if (empty_) {
+                return nullptr;
+            }
+            return mass + beg_index;
+        }
+
+        BUFF_CONSTEXPR20 size_t peek_size() const {
+            return detail::contiguous_size(beg_index, end_index, capacity_, empty_);
+        }
+
+        BUFF_CONSTEXPR20 void release(size_type n) {
+            if (n > size()) {
+                n = size();
+            }
+            stats_.on_get(n);
+            trace_.record(beg_index, n, capacity_);
+            drop_front(n);
+        }
+
+        BUFF_CONSTEXPR20 BufferStatsSnapshot stats() const {
+            return stats_.snapshot();
         }
 
-        Iterator<value_type> end() {
-            return Iterator<value_type, Allocator>(capacity_, mass, beg_index, end_index, end_index, empty_, false);
+        BUFF_CONSTEXPR20 const typename LatencyTrace::Histogram &latency() const {
+            return trace_.histogram();
         }
 
-        ConstIterator<value_type> cbegin() const {
-            return ConstIterator<value_type, Allocator>(capacity_, mass, beg_index, end_index, beg_index, empty_,
-                                                        true);
+        BUFF_CONSTEXPR20 iterator begin() {
+            return CreateIterator(0);
         }
 
-        ConstIterator<value_type> cend() const {
-            return ConstIterator<value_type, Allocator>(capacity_, mass, beg_index, end_index, end_index, empty_,
-                                                        false);
+        BUFF_CONSTEXPR20 iterator end() {
+            return CreateIterator(size());
         }
 
-        reverse_iterator rbegin() {
-            Iterator<value_type, Allocator> i(capacity_, mass, beg_index, end_index, end_index, empty_, false);
-            return std::reverse_iterator<Iterator<value_type, Allocator>>(i);
+        BUFF_CONSTEXPR20 const_iterator begin() const {
+            return cbegin();
         }
 
-        reverse_iterator rend() {
-            Iterator<value_type, Allocator> i(capacity_, mass, beg_index, end_index, beg_index, empty_, true);
-            return std::reverse_iterator<Iterator<value_type, Allocator>>(i);
+        BUFF_CONSTEXPR20 const_iterator end() const {
+            return cend();
         }
 
-        const_reverse_iterator rcbegin() const {
-            ConstIterator<value_type, Allocator> i(capacity_, mass, beg_index, end_index, end_index, empty_, false);
-            return std::reverse_iterator<ConstIterator<value_type, Allocator>>(i);
+        BUFF_CONSTEXPR20 const_iterator cbegin() const {
+            return CreateConstIterator(0);
         }
 
-        const_reverse_iterator rcend() const {
-            ConstIterator<value_type, Allocator> i(capacity_, mass, beg_index, end_index, end_index, empty_, true);
-            return std::reverse_iterator<ConstIterator<value_type, Allocator>>(i);
+        BUFF_CONSTEXPR20 const_iterator cend() const {
+            return CreateConstIterator(size());
         }
 
-        value_type &operator[](size_t idx) {
-            return *(begin() + idx);
+        BUFF_CONSTEXPR20 reverse_iterator rbegin() {
+            return reverse_iterator(end());
         }
 
-        const T &operator[](size_t idx) const {
-            return cbegin()[idx];
+        BUFF_CONSTEXPR20 reverse_iterator rend() {
+            return reverse_iterator(begin());
         }
 
-        const T &front() const {
+        BUFF_CONSTEXPR20 const_reverse_iterator rcbegin() const {
+            return const_reverse_iterator(cend());
+        }
+
+        BUFF_CONSTEXPR20 const_reverse_iterator rcend() const {
+            return const_reverse_iterator(cbegin());
+        }
+
+        BUFF_CONSTEXPR20 value_type &operator[](size_t idx) {
+            return mass[detail::ring_index(beg_index, idx, capacity_)];
+        }
+
+        BUFF_CONSTEXPR20 const T &operator[](size_t idx) const {
+            return mass[detail::ring_index(beg_index, idx, capacity_)];
+        }
+
+        BUFF_CONSTEXPR20 const T &front() const {
             return mass[(beg_index)];
         }
 
-        const T &back() const {
+        BUFF_CONSTEXPR20 const T &back() const {
             if (end_index == 0) {
                 return mass[capacity_ - 1];
             }
             return mass[end_index - 1];
         }
 
-        CCircularBufferBase &operator=(const CCircularBufferBase &other) {
-            uint64_t j = beg_index;
-            for (uint64_t i = 0; i < size(); i++) {
-                allocator_.destroy(mass + j);
-                j = (j + 1) % capacity_;
-            }
-            if (capacity_ > 0) {
-                allocator_.deallocate(mass, capacity_);
+        BUFF_CONSTEXPR20 std::pair<Segment<T>, Segment<T>> segments() {
+            return range(mass, 0, size());
+        }
+
+        BUFF_CONSTEXPR20 std::pair<Segment<const T>, Segment<const T>> segments() const {
+            return range<const T>(mass, 0, size());
+        }
+
+        // Часть part из parts примерно равных частей, для раздачи потокам; при part >= parts (и parts == 0) - пустая
+        BUFF_CONSTEXPR20 std::pair<Segment<T>, Segment<T>> partition(size_t part, size_t parts) {
+            if (part >= parts) {
+                return range(mass, 0, 0);
             }
+            size_t from = size() * part / parts;
+            return range(mass, from, size() * (part + 1) / parts - from);
+        }
 
-            capacity_ = other.capacity_;
-            end_index = other.end_index;
-            beg_index = other.beg_index;
-            empty_ = other.empty_;
-            allocator_ = other.allocator_;
+        BUFF_CONSTEXPR20 std::pair<Segment<const T>, Segment<const T>> partition(size_t part, size_t parts) const {
+            if (part >= parts) {
+                return range<const T>(mass, 0, 0);
+            }
+            size_t from = size() * part / parts;
+            return range<const T>(mass, from, size() * (part + 1) / parts - from);
+        }
 
-            if (capacity_ != 0) {
-                mass = allocator_.allocate(capacity_);
-                for (uint64_t i = 0; i < other.size(); i++) {
-                    allocator_.construct(mass + i + beg_index, other[i]);
+        // При совпадении емкостей память переиспользуется; элементы other ложатся подряд с нулевого слота
+        BUFF_CONSTEXPR20 CCircularBufferBase &operator=(const CCircularBufferBase &other) {
+            if (this == &other) {
+                return *this;
+            }
+            if (capacity_ != other.capacity_) {
+                // новая память берется до освобождения старой: если allocate бросит, буфер останется целым
+                Allocator allocator = other.allocator_;
+                T *mass2 = other.capacity_ != 0 ?
+                           std::allocator_traits<Allocator>::allocate(allocator, other.capacity_) : nullptr;
+                try {
+                    trace_.resize(other.capacity_);
+                } catch (...) {
+                    if (other.capacity_ != 0) {
+                        std::allocator_traits<Allocator>::deallocate(allocator, mass2, other.capacity_);
+                    }
+                    throw;
                 }
+                clear();
+                if (capacity_ > 0) {
+                    std::allocator_traits<Allocator>::deallocate(allocator_, mass, capacity_);
+                }
+                allocator_ = allocator;
+                capacity_ = other.capacity_;
+                mass = mass2;
+            } else {
+                clear();
+                trace_.resize(capacity_);
             }
+            copy_elements(other);
             return *this;
         }
 
-        bool operator==(const CCircularBufferBase &lhs) const {
-            if (empty_ != lhs.empty_ or size() != lhs.size()) {
+        // Забирает память other, оставляя ему память этого буфера
+        BUFF_CONSTEXPR20 CCircularBufferBase &operator=(CCircularBufferBase &&other) noexcept {
+            swap(other);
+            return *this;
+        }
+
+        // Сравнивает буферы по отрезкам, на которых сегменты обоих буферов непрерывны
+        BUFF_CONSTEXPR20 bool operator==(const CCircularBufferBase &lhs) const {
+            if (size() != lhs.size()) {
                 return false;
             }
-            for (uint64_t i = 0; i < size(); i++) {
-                if ((*this)[i] != lhs[i]) {
+            std::pair<Segment<const T>, Segment<const T>> mine = segments();
+            std::pair<Segment<const T>, Segment<const T>> theirs = lhs.segments();
+            const Segment<const T> left[2] = {mine.first, mine.second};
+            const Segment<const T> right[2] = {theirs.first, theirs.second};
+            size_t left_segment = 0, left_offset = 0, right_segment = 0, right_offset = 0;
+            for (size_t remaining = size(); remaining > 0;) {
+                size_t left_size = left[left_segment].size - left_offset;
+                size_t right_size = right[right_segment].size - right_offset;
+                size_t count = left_size < right_size ? left_size : right_size;
+                if (!equal_elements(left[left_segment].data + left_offset, right[right_segment].data + right_offset,
+                                    count)) {
                     return false;
                 }
+                remaining -= count;
+                left_offset += count;
+                right_offset += count;
+                if (left_offset == left[left_segment].size) {
+                    ++left_segment;
+                    left_offset = 0;
+                }
+                if (right_offset == right[right_segment].size) {
+                    ++right_segment;
+                    right_offset = 0;
+                }
             }
             return true;
         }
 
-        bool operator!=(const CCircularBufferBase &lhs) const {
+        BUFF_CONSTEXPR20 bool operator!=(const CCircularBufferBase &lhs) const {
             return !(*this == lhs);
         }
 
-        void swap(CCircularBufferBase &lhs) {
-            std::swap<CCircularBufferBase>(*this, lhs);
+        // Меняет местами память и индексы, элементы не копируются; статистика остается у своего буфера
+        BUFF_CONSTEXPR20 void swap(CCircularBufferBase &lhs) {
+            std::swap(mass, lhs.mass);
+            std::swap(capacity_, lhs.capacity_);
+            std::swap(allocator_, lhs.allocator_);
+            std::swap(end_index, lhs.end_index);
+            std::swap(beg_index, lhs.beg_index);
+            std::swap(empty_, lhs.empty_);
+            trace_.swap_stamps(lhs.trace_);
         }
 
-        CCircularBufferBase() : capacity_(0), beg_index(0), end_index(0), empty_(true) {};
+        BUFF_CONSTEXPR20 CCircularBufferBase() : mass(nullptr), capacity_(0), beg_index(0), end_index(0), empty_(true) {};
 
-        CCircularBufferBase(const CCircularBufferBase &other) : allocator_(other.allocator_) {
+        BUFF_CONSTEXPR20 CCircularBufferBase(const CCircularBufferBase &other) : allocator_(other.allocator_) {
             setCapacity(other.capacity_);
-            end_index = other.end_index;
-            beg_index = other.beg_index;
-            empty_ = other.empty_;
-            for (uint64_t i = 0; i < other.size(); i++) {
-                std::allocator_traits<Allocator>::construct(allocator_, mass + (beg_index + i) % capacity_, other[i]);
-            }
+            copy_elements(other);
+        }
+
+        BUFF_CONSTEXPR20 CCircularBufferBase(CCircularBufferBase &&other) noexcept : CCircularBufferBase() {
+            swap(other);
         }
 
-        CCircularBufferBase(size_t n, const T &value) {
+        BUFF_CONSTEXPR20 CCircularBufferBase(size_t n, const T &value) {
             setCapacity(n);
             for (uint64_t i = 0; i < capacity_; i++) {
                 std::allocator_traits<Allocator>::construct(allocator_, mass + i, value);
@@ -504,7 +594,7 @@ namespace buff {
         }
 
         template<typename InputIterator, typename = std::_RequireInputIter<InputIterator>>
-        CCircularBufferBase(InputIterator first, InputIterator last): capacity_(0), beg_index(0), end_index(0),
+        BUFF_CONSTEXPR20 CCircularBufferBase(InputIterator first, InputIterator last): capacity_(0), beg_index(0), end_index(0),
                                                                       empty_(true) {
             uint64_t n = std::distance(first, last);
             setCapacity(n);
@@ -516,14 +606,14 @@ namespace buff {
             return;
         }
 
-        CCircularBufferBase(const std::initializer_list<value_type> &list) : CCircularBufferBase(list.begin(),
+        BUFF_CONSTEXPR20 CCircularBufferBase(const std::initializer_list<value_type> &list) : CCircularBufferBase(list.begin(),
                                                                                                  list.end()) {}
 
-        CCircularBufferBase(size_t capacity) {
+        BUFF_CONSTEXPR20 CCircularBufferBase(size_t capacity) {
             setCapacity(capacity);
         }
 
-        virtual ~CCircularBufferBase() {
+        BUFF_CONSTEXPR20 virtual ~CCircularBufferBase() {
             uint64_t j = beg_index;
             for (uint64_t i = 0; i < size(); i++) {
                 std::allocator_traits<Allocator>::destroy(allocator_, mass + j);
@@ -537,31 +627,130 @@ namespace buff {
     protected:
         T *mass;
         size_t capacity_;
-        size_t end_index;
-        size_t beg_index;
+        BUFF_CACHE_ALIGNED size_t end_index;
+#ifdef BUFF_CACHE_LINE_LAYOUT
+        // счетчики и метки пишет писатель; то, что пишет читатель (gets, гистограмма задержек),
+        // внутри stats_ и trace_ вынесено на отдельные линии
+        BufferStats stats_;
+        LatencyTrace trace_;
+#endif
+        BUFF_CACHE_ALIGNED size_t beg_index;
         bool empty_;
         Allocator allocator_;
+#ifndef BUFF_CACHE_LINE_LAYOUT
+        BufferStats stats_;
+        LatencyTrace trace_;
+#endif
+
+        BUFF_CONSTEXPR20 iterator CreateIterator(size_t pos) const {
+            return iterator(mass, capacity_, beg_index, pos);
+        }
+
+        BUFF_CONSTEXPR20 const_iterator CreateConstIterator(size_t pos) const {
+            return const_iterator(mass, capacity_, beg_index, pos);
+        }
 
-        Iterator<T>
-        CreateIterator(size_t capacity, T *ptr, size_t beg, size_t end, size_t ind, bool empty, bool isBeg) {
-            return Iterator<value_type, Allocator>(capacity, ptr, beg, end, ind, empty, isBeg);
+        // Элементы [from, from + count) в порядке буфера; второй сегмент непуст, если диапазон пересекает конец mass
+        template<class Pointer>
+        BUFF_CONSTEXPR20 std::pair<Segment<Pointer>, Segment<Pointer>> range(Pointer *data, size_t from, size_t count) const {
+            if (count == 0) {
+                return {{data, 0}, {data, 0}};
+            }
+            size_t first = detail::ring_index(beg_index, from, capacity_);
+            size_t first_size = capacity_ - first < count ? capacity_ - first : count;
+            return {{data + first, first_size}, {data, count - first_size}};
         }
 
-        const_iterator
-        CreateConstIterator(size_t capacity, T *ptr, size_t beg, size_t end, size_t ind, bool empty, bool isBeg) {
-            return ConstIterator<value_type, Allocator>(capacity, ptr, beg, end, ind, empty, isBeg);
+        // Помечает n уже сконструированных элементов после end_index как положенные
+        BUFF_CONSTEXPR20 void advance_end(size_type n) {
+            if (n == 0) {
+                return;
+            }
+            trace_.stamp(end_index, n, capacity_);
+            end_index = detail::ring_index(end_index, n, capacity_);
+            if (empty_) {
+                empty_ = false;
+            }
+            stats_.on_put(size(), capacity_, n);
         }
 
-        void setCapacity(size_t capacity) {
+        BUFF_CONSTEXPR20 void drop_front(size_type n) {
+            for (uint64_t i = 0; i < n; i++) {
+                std::allocator_traits<Allocator>::destroy(allocator_, mass + beg_index);
+                beg_index = detail::next_index(beg_index, capacity_);
+            }
+            if (n > 0 and beg_index == end_index) {
+                empty_ = true;
+            }
+        }
+
+        // Кладет элементы other подряд с нулевого слота; буфер должен быть пуст, а емкость - не меньше other.size()
+        BUFF_CONSTEXPR20 void copy_elements(const CCircularBufferBase &other) {
+            std::pair<Segment<const T>, Segment<const T>> source = other.segments();
+            size_t count = source.first.size + source.second.size;
+            construct_segments<false>(mass, source);
+            beg_index = 0;
+            end_index = count == capacity_ ? 0 : count;
+            empty_ = count == 0;
+        }
+
+        // Конструирует в dest подряд элементы двух сегментов: копирует, а при Move перемещает (если это noexcept);
+        // тривиально копируемые T переносятся memcpy
+        template<bool Move, class Pointer>
+        BUFF_CONSTEXPR20 void construct_segments(T *dest, const std::pair<Segment<Pointer>, Segment<Pointer>> &source) {
+            if constexpr (std::is_trivially_copyable<T>::value) {
+                if (detail::bulk_ops_allowed()) {
+                    if (source.first.size != 0) {
+                        std::memcpy(dest, source.first.data, source.first.size * sizeof(T));
+                    }
+                    if (source.second.size != 0) {
+                        std::memcpy(dest + source.first.size, source.second.data, source.second.size * sizeof(T));
+                    }
+                    return;
+                }
+            }
+            for (Pointer &value: source.first) {
+                construct_element<Move>(dest++, value);
+            }
+            for (Pointer &value: source.second) {
+                construct_element<Move>(dest++, value);
+            }
+        }
+
+        template<bool Move, class Value>
+        BUFF_CONSTEXPR20 void construct_element(T *dest, Value &value) {
+            if constexpr (Move) {
+                std::allocator_traits<Allocator>::construct(allocator_, dest, std::move_if_noexcept(value));
+            } else {
+                std::allocator_traits<Allocator>::construct(allocator_, dest, value);
+            }
+        }
+
+        BUFF_CONSTEXPR20 static bool equal_elements(const T *lhs, const T *rhs, size_t count) {
+            if constexpr (std::has_unique_object_representations<T>::value) {
+                if (detail::bulk_ops_allowed()) {
+                    return std::memcmp(lhs, rhs, count * sizeof(T)) == 0;
+                }
+            }
+            for (size_t i = 0; i < count; i++) {
+                if (lhs[i] != rhs[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        BUFF_CONSTEXPR20 void setCapacity(size_t capacity) {
             capacity_ = capacity;
             mass = std::allocator_traits<Allocator>::allocate(allocator_, capacity);
+            trace_.resize(capacity);
             beg_index = 0;
             end_index = 0;
             empty_ = true;
         }
     };
 
-    template<class T, class Allocator = std::allocator<T>>
+    template<class T, class Allocator>
     class CCircularBuffer : public CCircularBufferBase<T, Allocator> {
     public:
         typedef T value_type;
@@ -569,32 +758,35 @@ namespace buff {
         typedef const value_type *const_pointer;
         typedef value_type &reference;
         typedef const value_type &const_reference;
-        typedef ConstIterator<T> const_iterator;
+        typedef ConstIterator<T, Allocator> const_iterator;
         typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
-        typedef std::reverse_iterator<Iterator<T>> reverse_iterator;
+        typedef std::reverse_iterator<Iterator<T, Allocator>> reverse_iterator;
         typedef size_t size_type;
         typedef ptrdiff_t difference_type;
 
-        CCircularBuffer() : CCircularBufferBase<T, Allocator>() {};
+        BUFF_CONSTEXPR20 CCircularBuffer() : CCircularBufferBase<T, Allocator>() {};
 
-        void put(const T &value) {
+        BUFF_CONSTEXPR20 pointer reserve_slot() {
             if (this->capacity_ == 0) {
-                return;
+                return nullptr;
             }
-            this->allocator_.construct(this->mass + this->end_index, value_type());
-            if (!this->empty_ && this->end_index == this->beg_index) {
-                std::allocator_traits<Allocator>::construct(this->allocator_, this->mass + this->beg_index, value);
-                this->beg_index++;
-                this->end_index++;
-                return;
+            if (!this->empty_ and this->end_index == this->beg_index) {
+                this->stats_.on_overwrite();
+                this->drop_front(1);
             }
+            return this->mass + this->end_index;
+        }
 
-            std::allocator_traits<Allocator>::construct(this->allocator_, this->mass + this->end_index, value);
-            this->end_index = (this->end_index + 1) % this->capacity_;
-            this->empty_ = false;
+        BUFF_CONSTEXPR20 void put(const T &value) {
+            pointer slot = reserve_slot();
+            if (slot == nullptr) {
+                return;
+            }
+            std::allocator_traits<Allocator>::construct(this->allocator_, slot, value);
+            this->commit();
         }
 
-        void resize(size_type new_size) {
+        BUFF_CONSTEXPR20 void resize(size_type new_size) {
             if (new_size >= this->capacity_) {
                 return;
             }
@@ -621,42 +813,62 @@ namespace buff {
             }
         }
 
-        CCircularBuffer(const std::initializer_list<value_type> &list) : CCircularBufferBase<T, Allocator>(list) {};
+        BUFF_CONSTEXPR20 CCircularBuffer(const std::initializer_list<value_type> &list) : CCircularBufferBase<T, Allocator>(list) {};
+
+        BUFF_CONSTEXPR20 CCircularBuffer(size_t capacity) : CCircularBufferBase<T, Allocator>(capacity) {}
+
+        BUFF_CONSTEXPR20 CCircularBuffer(const CCircularBuffer &other) : CCircularBufferBase<T, Allocator>(other) {};
+
+        BUFF_CONSTEXPR20 CCircularBuffer(CCircularBuffer &&other) noexcept = default;
 
-        CCircularBuffer(size_t capacity) : CCircularBufferBase<T, Allocator>(capacity) {}
+        BUFF_CONSTEXPR20 CCircularBuffer &operator=(const CCircularBuffer &) = default;
 
-        CCircularBuffer(const CCircularBuffer &other) : CCircularBufferBase<T, Allocator>(other) {};
+        BUFF_CONSTEXPR20 CCircularBuffer &operator=(CCircularBuffer &&) noexcept = default;
 
-        CCircularBuffer(size_t n, const T &value) : CCircularBufferBase<T, Allocator>(n, value) {}
+        // Без этой перегрузки swap(a, b) выбирает std::swap для производного класса вместо обмена памятью
+        friend BUFF_CONSTEXPR20 void swap(CCircularBuffer &lhs, CCircularBuffer &rhs) {
+            lhs.swap(rhs);
+        }
+
+        BUFF_CONSTEXPR20 CCircularBuffer(size_t n, const T &value) : CCircularBufferBase<T, Allocator>(n, value) {}
 
         template<typename InputIterator, typename = std::_RequireInputIter<InputIterator>>
-        CCircularBuffer(InputIterator first, InputIterator last) : CCircularBufferBase<T, Allocator>(first, last) {}
+        BUFF_CONSTEXPR20 CCircularBuffer(InputIterator first, InputIterator last) : CCircularBufferBase<T, Allocator>(first, last) {}
 
         ~CCircularBuffer() = default;
     };
 
-    template<class T, class Allocator = std::allocator<T>>
+    template<class T, class Allocator>
     class CCircularBufferExt : public CCircularBufferBase<T, Allocator> {
     public:
         typedef T value_type;
         typedef value_type *pointer;
         typedef size_t size_type;
 
-        CCircularBufferExt() : CCircularBufferBase<T, Allocator>() {};
+        BUFF_CONSTEXPR20 CCircularBufferExt() : CCircularBufferBase<T, Allocator>() {};
 
-        CCircularBufferExt(const CCircularBufferExt &other) : CCircularBufferBase<T, Allocator>(other) {};
+        BUFF_CONSTEXPR20 CCircularBufferExt(const CCircularBufferExt &other) : CCircularBufferBase<T, Allocator>(other) {};
 
+        BUFF_CONSTEXPR20 CCircularBufferExt(CCircularBufferExt &&other) noexcept = default;
 
-        CCircularBufferExt(size_t capacity) : CCircularBufferBase<T, Allocator>(capacity) {};
+        BUFF_CONSTEXPR20 CCircularBufferExt &operator=(const CCircularBufferExt &) = default;
 
-        CCircularBufferExt(size_t n, const T &value) : CCircularBufferBase<T, Allocator>(n, value) {};
+        BUFF_CONSTEXPR20 CCircularBufferExt &operator=(CCircularBufferExt &&) noexcept = default;
+
+        friend BUFF_CONSTEXPR20 void swap(CCircularBufferExt &lhs, CCircularBufferExt &rhs) {
+            lhs.swap(rhs);
+        }
+
+        BUFF_CONSTEXPR20 CCircularBufferExt(size_t capacity) : CCircularBufferBase<T, Allocator>(capacity) {};
+
+        BUFF_CONSTEXPR20 CCircularBufferExt(size_t n, const T &value) : CCircularBufferBase<T, Allocator>(n, value) {};
 
         template<typename InputIterator, typename = std::_RequireInputIter<InputIterator>>
-        CCircularBufferExt(InputIterator first, InputIterator last):CCircularBufferBase<T, Allocator>(first, last) {};
+        BUFF_CONSTEXPR20 CCircularBufferExt(InputIterator first, InputIterator last):CCircularBufferBase<T, Allocator>(first, last) {};
 
-        CCircularBufferExt(const std::initializer_list<value_type> &list) : CCircularBufferBase<T, Allocator>(list) {};
+        BUFF_CONSTEXPR20 CCircularBufferExt(const std::initializer_list<value_type> &list) : CCircularBufferBase<T, Allocator>(list) {};
 
-        void resize(size_type new_size) {
+        BUFF_CONSTEXPR20 void resize(size_type new_size) {
             if (new_size > this->capacity_) {
                 this->reserve(new_size);
             }
@@ -683,7 +895,7 @@ namespace buff {
             }
         }
 
-        void put(const T &value) {
+        BUFF_CONSTEXPR20 pointer reserve_slot() {
             if (this->size() == this->capacity_) {
                 if (this->capacity_ == 0) {
                     this->reserve(1);
@@ -691,16 +903,19 @@ namespace buff {
                     this->reserve(2 * this->capacity_);
                 }
             }
-            std::allocator_traits<Allocator>::construct(this->allocator_, this->mass + this->end_index, value);
-            this->end_index = (this->end_index + 1) % this->capacity_;
-            this->empty_ = false;
+            return this->mass + this->end_index;
+        }
+
+        BUFF_CONSTEXPR20 void put(const T &value) {
+            std::allocator_traits<Allocator>::construct(this->allocator_, reserve_slot(), value);
+            this->commit();
         }
 
         ~CCircularBufferExt() = default;
     };
 
-    template<class T>
-    void swap(CCircularBufferBase<T> &lhs, CCircularBufferBase<T> &rhs) {
+    template<class T, class Allocator>
+    void swap(CCircularBufferBase<T, Allocator> &lhs, CCircularBufferBase<T, Allocator> &rhs) {
         lhs.swap(rhs);
     }
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#if defined(__cpp_lib_constexpr_dynamic_alloc) && defined(__cpp_constexpr_dynamic_alloc)
+#define BUFF_CONSTEXPR20 constexpr
+#else
+#define BUFF_CONSTEXPR20
+#endif
+
+namespace buff {
+
+    template<class T, class Allocator = std::allocator<T>>
+    class CCircularBufferBase;
+
+    template<class T, class Allocator, bool Const>
+    class RingIterator;
+
+    template<class T, class Allocator = std::allocator<T>>
+    using Iterator = RingIterator<T, Allocator, false>;
+
+    template<class T, class Allocator = std::allocator<T>>
+    using ConstIterator = RingIterator<T, Allocator, true>;
+
+    template<class T, class Allocator = std::allocator<T>>
+    class CCircularBuffer;
+
+    template<class T, class Allocator = std::allocator<T>>
+    class CCircularBufferExt;
+
+    template<class T, size_t N>
+    class StaticCircularBuffer;
+}
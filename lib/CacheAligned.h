@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+#ifdef BUFF_CACHE_LINE_LAYOUT
+#define BUFF_CACHE_ALIGNED alignas(buff::kCacheLineSize)
+#else
+#define BUFF_CACHE_ALIGNED
+#endif
+
+namespace buff {
+
+    constexpr size_t kCacheLineSize = 64;
+    constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+    template<class T>
+    struct alignas(kCacheLineSize) CacheLinePadded {
+        T value;
+
+        CacheLinePadded() = default;
+
+        CacheLinePadded(const T &other) : value(other) {}
+
+        operator T &() {
+            return value;
+        }
+
+        operator const T &() const {
+            return value;
+        }
+
+        bool operator==(const CacheLinePadded &lhs) const {
+            return value == lhs.value;
+        }
+
+        bool operator!=(const CacheLinePadded &lhs) const {
+            return !(*this == lhs);
+        }
+    };
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "CacheAligned.h"
+
+namespace buff {
+
+    // Буферы от kHugePageSize и больше выравниваются по huge page и помечаются для THP
+    template<class T, size_t Alignment = kCacheLineSize>
+    class CacheAlignedAllocator {
+    public:
+        typedef T value_type;
+        typedef T *pointer;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        template<class U>
+        struct rebind {
+            typedef CacheAlignedAllocator<U, Alignment> other;
+        };
+
+        CacheAlignedAllocator() = default;
+
+        template<class U>
+        CacheAlignedAllocator(const CacheAlignedAllocator<U, Alignment> &) {}
+
+        pointer allocate(size_type n) {
+            size_t bytes = n * sizeof(T);
+            void *ptr = ::operator new(bytes, std::align_val_t(alignment(bytes)));
+#ifdef MADV_HUGEPAGE
+            if (bytes >= kHugePageSize) {
+                madvise(ptr, bytes, MADV_HUGEPAGE);
+            }
+#endif
+            return static_cast<pointer>(ptr);
+        }
+
+        void deallocate(pointer ptr, size_type n) {
+            size_t bytes = n * sizeof(T);
+            ::operator delete(ptr, std::align_val_t(alignment(bytes)));
+        }
+
+        size_type max_size() const {
+            return std::numeric_limits<size_type>::max() / sizeof(T);
+        }
+
+        bool operator==(const CacheAlignedAllocator &) const {
+            return true;
+        }
+
+        bool operator!=(const CacheAlignedAllocator &) const {
+            return false;
+        }
+
+    private:
+        static size_t alignment(size_t bytes) {
+            if (bytes >= kHugePageSize) {
+                return kHugePageSize;
+            }
+            return Alignment < alignof(T) ? alignof(T) : Alignment;
+        }
+    };
+}
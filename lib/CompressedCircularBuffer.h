@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "CCircularBuffer.h"
+
+namespace buff {
+
+    // Кольцо для длинных рядов целых чисел (метки времени, счетчики). Элементы хранятся блоками по BlockSize:
+    // заполненные блоки запечатываются и сжимаются (delta-of-delta + zigzag + varint), несжатым остается
+    // только последний блок. При переполнении с головы вытесняются целые блоки, поэтому хранится
+    // не меньше capacity последних элементов и меньше capacity + BlockSize.
+    template<class T, size_t BlockSize = 128>
+    class CompressedCircularBuffer {
+        static_assert(std::is_integral<T>::value, "CompressedCircularBuffer stores integers");
+        static_assert(BlockSize > 0, "BlockSize must be positive");
+
+        struct Block {
+            T first;
+            size_t count;
+            std::vector<uint8_t> bytes;
+        };
+
+        // кольцо блоков при росте перемещает их, не копируя сжатые байты
+        static_assert(std::is_nothrow_move_constructible<Block>::value, "Block must move without copying bytes");
+
+    public:
+        typedef T value_type;
+        typedef size_t size_type;
+
+        class ConstIterator {
+            friend CompressedCircularBuffer;
+        public:
+            typedef ptrdiff_t difference_type;
+            typedef T value_type;
+            typedef const T *pointer;
+            typedef const T &reference;
+            typedef std::forward_iterator_tag iterator_category;
+
+            ConstIterator() = default;
+
+            reference operator*() const {
+                return value_;
+            }
+
+            pointer operator->() const {
+                return &value_;
+            }
+
+            ConstIterator &operator++() {
+                ++pos_;
+                if (block_ < owner_->sealed_.size()) {
+                    if (pos_ < owner_->sealed_[block_].count) {
+                        decode_next();
+                        return *this;
+                    }
+                    ++block_;
+                    pos_ = 0;
+                }
+                load();
+                return *this;
+            }
+
+            ConstIterator operator++(int) {
+                ConstIterator old_value(*this);
+                ++(*this);
+                return old_value;
+            }
+
+            bool operator==(const ConstIterator &lhs) const {
+                return block_ == lhs.block_ and pos_ == lhs.pos_;
+            }
+
+            bool operator!=(const ConstIterator &lhs) const {
+                return !(*this == lhs);
+            }
+
+        private:
+            const CompressedCircularBuffer *owner_ = nullptr;
+            size_t block_ = 0;
+            size_t pos_ = 0;
+            size_t offset_ = 0;
+            uint64_t delta_ = 0;
+            T value_ = T();
+
+            ConstIterator(const CompressedCircularBuffer *owner, size_t block, size_t pos) : owner_(owner),
+                                                                                            block_(block),
+                                                                                            pos_(pos) {
+                load();
+            }
+
+            // Встает на элемент pos_ блока block_, который должен быть первым в запечатанном блоке или лежать в хвосте
+            void load() {
+                if (block_ < owner_->sealed_.size()) {
+                    value_ = owner_->sealed_[block_].first;
+                    offset_ = 0;
+                    delta_ = 0;
+                } else if (pos_ < owner_->tail_.size()) {
+                    value_ = owner_->tail_[pos_];
+                }
+            }
+
+            void decode_next() {
+                const std::vector<uint8_t> &bytes = owner_->sealed_[block_].bytes;
+                delta_ += unzigzag(read_varint(bytes, offset_));
+                value_ = static_cast<T>(static_cast<uint64_t>(value_) + delta_);
+            }
+        };
+
+        typedef ConstIterator const_iterator;
+
+        explicit CompressedCircularBuffer(size_t capacity) : capacity_(capacity) {
+            tail_.reserve(BlockSize);
+        }
+
+        size_t capacity() const {
+            return capacity_;
+        }
+
+        size_t size() const {
+            return sealed_size_ + tail_.size();
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        void put(T value) {
+            tail_.push_back(value);
+            if (tail_.size() == BlockSize) {
+                seal();
+            }
+            while (!sealed_.empty() and size() - sealed_.front().count >= capacity_) {
+                sealed_size_ -= sealed_.front().count;
+                sealed_.release(1);
+            }
+        }
+
+        void clear() {
+            sealed_.clear();
+            sealed_size_ = 0;
+            tail_.clear();
+        }
+
+        T back() const {
+            if (!tail_.empty()) {
+                return tail_.back();
+            }
+            T ret = T();
+            for (ConstIterator it = sealed_begin(sealed_.size() - 1); it != cend(); ++it) {
+                ret = *it;
+            }
+            return ret;
+        }
+
+        T front() const {
+            if (!sealed_.empty()) {
+                return sealed_.front().first;
+            }
+            if (tail_.empty()) {
+                return T();
+            }
+            return tail_.front();
+        }
+
+        const_iterator begin() const {
+            return cbegin();
+        }
+
+        const_iterator end() const {
+            return cend();
+        }
+
+        const_iterator cbegin() const {
+            return sealed_begin(0);
+        }
+
+        const_iterator cend() const {
+            return ConstIterator(this, sealed_.size(), tail_.size());
+        }
+
+        // Байт, выделенных под элементы: хвост, все слоты кольца блоков (и занятые, и свободные) и сжатые байты
+        size_t memory_bytes() const {
+            size_t ret = tail_.capacity() * sizeof(T) + sealed_.capacity() * sizeof(Block);
+            for (const Block &block: sealed_) {
+                ret += block.bytes.capacity();
+            }
+            return ret;
+        }
+
+    private:
+        size_t capacity_;
+        size_t sealed_size_ = 0;
+        CCircularBufferExt<Block> sealed_;
+        std::vector<T> tail_;
+
+        ConstIterator sealed_begin(size_t block) const {
+            if (block >= sealed_.size()) {
+                return ConstIterator(this, sealed_.size(), 0);
+            }
+            return ConstIterator(this, block, 0);
+        }
+
+        void seal() {
+            Block *block = sealed_.reserve_slot();
+            new(block) Block{tail_[0], tail_.size(), {}};
+            block->bytes.reserve(tail_.size());
+            uint64_t delta = 0;
+            for (size_t i = 1; i < tail_.size(); i++) {
+                uint64_t current = static_cast<uint64_t>(tail_[i]) - static_cast<uint64_t>(tail_[i - 1]);
+                write_varint(block->bytes, zigzag(current - delta));
+                delta = current;
+            }
+            block->bytes.shrink_to_fit();
+            sealed_.commit();
+            sealed_size_ += tail_.size();
+            tail_.clear();
+        }
+
+        static uint64_t zigzag(uint64_t value) {
+            return (value << 1) ^ (0 - (value >> 63));
+        }
+
+        static uint64_t unzigzag(uint64_t value) {
+            return (value >> 1) ^ (0 - (value & 1));
+        }
+
+        static void write_varint(std::vector<uint8_t> &bytes, uint64_t value) {
+            while (value >= 0x80) {
+                bytes.push_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            bytes.push_back(static_cast<uint8_t>(value));
+        }
+
+        static uint64_t read_varint(const std::vector<uint8_t> &bytes, size_t &offset) {
+            uint64_t ret = 0;
+            for (size_t shift = 0;; shift += 7) {
+                uint8_t byte = bytes[offset++];
+                ret |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0) {
+                    return ret;
+                }
+            }
+        }
+    };
+}
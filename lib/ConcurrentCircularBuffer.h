@@ -0,0 +1,266 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "CCircularBuffer.h"
+
+#if __has_include(<sys/eventfd.h>)
+#define BUFF_HAS_EVENTFD 1
+#include "EventFdNotifier.h"
+#endif
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define BUFF_HAS_COROUTINES 1
+#include <coroutine>
+#include <functional>
+#endif
+
+namespace buff {
+
+    // Ограниченный буфер для нескольких писателей и читателей: в отличие от CCircularBuffer не перезаписывает
+    // старые элементы, а отказывает в try_put (или приостанавливает async_put) при заполнении.
+    template<class T, class Allocator = std::allocator<T>>
+    class ConcurrentCircularBuffer {
+    public:
+        typedef T value_type;
+        typedef size_t size_type;
+
+        explicit ConcurrentCircularBuffer(size_t capacity) : buffer_(capacity) {}
+
+        ConcurrentCircularBuffer(const ConcurrentCircularBuffer &) = delete;
+
+        ConcurrentCircularBuffer &operator=(const ConcurrentCircularBuffer &) = delete;
+
+        size_t capacity() const {
+            return buffer_.capacity();
+        }
+
+        size_t size() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return buffer_.size();
+        }
+
+        bool empty() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return buffer_.empty();
+        }
+
+        bool try_put(const T &value) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            return put_locked(value, lock);
+        }
+
+        bool try_get(T &value) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            return get_locked(value, lock);
+        }
+
+        // Копирует первый элемент, не забирая его
+        bool try_peek(T &value) const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (buffer_.empty()) {
+                return false;
+            }
+            value = buffer_.front();
+            return true;
+        }
+
+#ifdef BUFF_HAS_EVENTFD
+        // Включает eventfd-уведомления только о фронтах: readable_fd() - буфер перестал быть пустым,
+        // writable_fd() - буфер перестал быть полным. После пробуждения нужно вызвать consume_*()
+        // и разбирать буфер до try_get() == false (или заполнять до try_put() == false), иначе фронта не будет.
+        // Сразу после включения дескрипторы отражают текущее состояние: непустой буфер уже readable,
+        // неполный - writable.
+        void enable_notifications() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!readable_) {
+                readable_ = std::make_unique<EventFdNotifier>();
+                writable_ = std::make_unique<EventFdNotifier>();
+                if (!buffer_.empty()) {
+                    readable_->notify();
+                }
+                if (buffer_.size() != buffer_.capacity()) {
+                    writable_->notify();
+                }
+            }
+        }
+
+        int readable_fd() const {
+            return readable_ ? readable_->fd() : -1;
+        }
+
+        int writable_fd() const {
+            return writable_ ? writable_->fd() : -1;
+        }
+
+        void consume_readable() {
+            if (readable_) {
+                readable_->consume();
+            }
+        }
+
+        void consume_writable() {
+            if (writable_) {
+                writable_->consume();
+            }
+        }
+#endif
+
+#ifdef BUFF_HAS_COROUTINES
+        typedef std::function<void(std::coroutine_handle<>)> Executor;
+
+        class PutAwaiter {
+            friend ConcurrentCircularBuffer;
+        public:
+            bool await_ready() const {
+                return false;
+            }
+
+            bool await_suspend(std::coroutine_handle<> handle) {
+                handle_ = handle;
+                std::unique_lock<std::mutex> lock(buffer_->mutex_);
+                if (buffer_->put_locked(value_, lock)) {
+                    return false;
+                }
+                buffer_->putters_.push_back(this);
+                return true;
+            }
+
+            void await_resume() const {}
+
+        private:
+            ConcurrentCircularBuffer *buffer_;
+            T value_;
+            std::coroutine_handle<> handle_;
+
+            PutAwaiter(ConcurrentCircularBuffer *buffer, T value) : buffer_(buffer), value_(std::move(value)) {}
+        };
+
+        class GetAwaiter {
+            friend ConcurrentCircularBuffer;
+        public:
+            bool await_ready() const {
+                return false;
+            }
+
+            bool await_suspend(std::coroutine_handle<> handle) {
+                handle_ = handle;
+                std::unique_lock<std::mutex> lock(buffer_->mutex_);
+                if (buffer_->get_locked(value_, lock)) {
+                    return false;
+                }
+                buffer_->getters_.push_back(this);
+                return true;
+            }
+
+            T await_resume() {
+                return std::move(value_);
+            }
+
+        private:
+            ConcurrentCircularBuffer *buffer_;
+            T value_ = T();
+            std::coroutine_handle<> handle_;
+
+            explicit GetAwaiter(ConcurrentCircularBuffer *buffer) : buffer_(buffer) {}
+        };
+
+        // Куда отдавать возобновляемые корутины; по умолчанию они возобновляются в потоке, который их разбудил
+        void set_executor(Executor executor) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            executor_ = std::move(executor);
+        }
+
+        PutAwaiter async_put(T value) {
+            return PutAwaiter(this, std::move(value));
+        }
+
+        GetAwaiter async_get() {
+            return GetAwaiter(this);
+        }
+#endif
+
+    private:
+        mutable std::mutex mutex_;
+        CCircularBuffer<T, Allocator> buffer_;
+#ifdef BUFF_HAS_EVENTFD
+        std::unique_ptr<EventFdNotifier> readable_;
+        std::unique_ptr<EventFdNotifier> writable_;
+#endif
+#ifdef BUFF_HAS_COROUTINES
+        std::deque<PutAwaiter *> putters_;
+        std::deque<GetAwaiter *> getters_;
+        Executor executor_;
+
+        void resume(std::coroutine_handle<> handle, std::unique_lock<std::mutex> &lock) {
+            Executor executor = executor_;
+            lock.unlock();
+            if (executor) {
+                executor(handle);
+            } else {
+                handle.resume();
+            }
+        }
+#endif
+
+        // Вызываются под mutex_; если будят ждущую корутину, отпускают lock
+        bool put_locked(const T &value, std::unique_lock<std::mutex> &lock) {
+#ifdef BUFF_HAS_COROUTINES
+            if (!getters_.empty()) {
+                GetAwaiter *getter = getters_.front();
+                getters_.pop_front();
+                getter->value_ = value;
+                resume(getter->handle_, lock);
+                return true;
+            }
+#endif
+            if (buffer_.size() == buffer_.capacity()) {
+                return false;
+            }
+#ifdef BUFF_HAS_EVENTFD
+            if (readable_ and buffer_.empty()) {
+                readable_->notify();
+            }
+#endif
+            buffer_.put(value);
+            return true;
+        }
+
+        bool get_locked(T &value, std::unique_lock<std::mutex> &lock) {
+            if (buffer_.empty()) {
+#ifdef BUFF_HAS_COROUTINES
+                if (!putters_.empty()) {
+                    PutAwaiter *putter = putters_.front();
+                    putters_.pop_front();
+                    value = std::move(putter->value_);
+                    resume(putter->handle_, lock);
+                    return true;
+                }
+#endif
+                return false;
+            }
+#ifdef BUFF_HAS_EVENTFD
+            bool was_full = buffer_.size() == buffer_.capacity();
+#endif
+            value = buffer_.get();
+#ifdef BUFF_HAS_COROUTINES
+            if (!putters_.empty()) {
+                // ждущий писатель сразу занимает освободившееся место, заполненность не меняется
+                PutAwaiter *putter = putters_.front();
+                putters_.pop_front();
+                buffer_.put(putter->value_);
+                resume(putter->handle_, lock);
+                return true;
+            }
+#endif
+#ifdef BUFF_HAS_EVENTFD
+            if (writable_ and was_full) {
+                writable_->notify();
+            }
+#endif
+            return true;
+        }
+    };
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace buff {
+
+    // Неблокирующий eventfd: notify() делает дескриптор читаемым для poll/epoll, consume() сбрасывает его
+    class EventFdNotifier {
+    public:
+        EventFdNotifier() : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+
+        EventFdNotifier(const EventFdNotifier &) = delete;
+
+        EventFdNotifier &operator=(const EventFdNotifier &) = delete;
+
+        ~EventFdNotifier() {
+            if (fd_ >= 0) {
+                close(fd_);
+            }
+        }
+
+        int fd() const {
+            return fd_;
+        }
+
+        void notify() {
+            uint64_t one = 1;
+            ssize_t ret = write(fd_, &one, sizeof(one));
+            (void) ret;
+        }
+
+        // Возвращает число notify() с прошлого consume()
+        uint64_t consume() {
+            uint64_t count = 0;
+            if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+                return 0;
+            }
+            return count;
+        }
+
+    private:
+        int fd_;
+    };
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace buff {
+
+    // Лог-линейная гистограмма в духе HDR: 16 корзин на каждую степень двойки, точность ~6%
+    class LatencyHistogram {
+    public:
+        static constexpr size_t kSubBucketBits = 4;
+        static constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+        static constexpr size_t kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+        LatencyHistogram() = default;
+
+        LatencyHistogram(const LatencyHistogram &) = delete;
+
+        LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+        void record(uint64_t value) {
+            buckets_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+            count_.fetch_add(1, std::memory_order_relaxed);
+            if (value > max_.load(std::memory_order_relaxed)) {
+                max_.store(value, std::memory_order_relaxed);
+            }
+        }
+
+        uint64_t count() const {
+            return count_.load(std::memory_order_relaxed);
+        }
+
+        uint64_t max() const {
+            return max_.load(std::memory_order_relaxed);
+        }
+
+        // Верхняя граница корзины, в которую попадает перцентиль percentile (0..100)
+        uint64_t value_at_percentile(double percentile) const {
+            uint64_t total = count();
+            if (total == 0) {
+                return 0;
+            }
+            uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total));
+            if (rank == 0) {
+                rank = 1;
+            }
+            if (rank > total) {
+                rank = total;
+            }
+            uint64_t seen = 0;
+            for (size_t i = 0; i < kBuckets; i++) {
+                seen += buckets_[i].load(std::memory_order_relaxed);
+                if (seen >= rank) {
+                    uint64_t upper = bucket_upper_bound(i);
+                    return upper < max() ? upper : max();
+                }
+            }
+            return max();
+        }
+
+        void reset() {
+            for (size_t i = 0; i < kBuckets; i++) {
+                buckets_[i].store(0, std::memory_order_relaxed);
+            }
+            count_.store(0, std::memory_order_relaxed);
+            max_.store(0, std::memory_order_relaxed);
+        }
+
+        static size_t bucket_index(uint64_t value) {
+            if (value < kSubBuckets) {
+                return value;
+            }
+            size_t exponent = 63 - __builtin_clzll(value);
+            size_t sub = (value >> (exponent - kSubBucketBits)) & (kSubBuckets - 1);
+            return (exponent - kSubBucketBits + 1) * kSubBuckets + sub;
+        }
+
+        static uint64_t bucket_upper_bound(size_t index) {
+            if (index < kSubBuckets) {
+                return index;
+            }
+            size_t exponent = index / kSubBuckets + kSubBucketBits - 1;
+            uint64_t sub = index % kSubBuckets;
+            uint64_t step = uint64_t(1) << (exponent - kSubBucketBits);
+            return ((kSubBuckets + sub) << (exponent - kSubBucketBits)) + step - 1;
+        }
+
+    private:
+        std::atomic<uint64_t> buckets_[kBuckets] = {};
+        std::atomic<uint64_t> count_{0};
+        std::atomic<uint64_t> max_{0};
+    };
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef BUFF_ENABLE_LATENCY_TRACE
+#include <chrono>
+#include <vector>
+
+#include "CacheAligned.h"
+#include "LatencyHistogram.h"
+#endif
+
+namespace buff {
+
+    // Пустая гистограмма буферов без BUFF_ENABLE_LATENCY_TRACE, с тем же интерфейсом чтения, что у LatencyHistogram
+    class NoLatencyHistogram {
+    public:
+        constexpr uint64_t count() const {
+            return 0;
+        }
+
+        constexpr uint64_t max() const {
+            return 0;
+        }
+
+        constexpr uint64_t value_at_percentile(double) const {
+            return 0;
+        }
+    };
+
+    class NoLatencyTrace {
+    public:
+        typedef NoLatencyHistogram Histogram;
+
+        constexpr void resize(size_t) {}
+
+        constexpr void relocate(size_t, size_t, size_t, size_t) {}
+
+        constexpr void stamp(size_t) {}
+
+        constexpr void stamp(size_t, size_t, size_t) {}
+
+        constexpr void record(size_t, size_t, size_t) {}
+
+        constexpr void swap_stamps(NoLatencyTrace &) {}
+
+        constexpr const NoLatencyHistogram &histogram() const {
+            return empty_;
+        }
+
+    private:
+        static constexpr NoLatencyHistogram empty_{};
+    };
+
+#ifdef BUFF_ENABLE_LATENCY_TRACE
+
+    // Время нахождения элемента в буфере в наносекундах steady_clock; 0 в слоте - элемент положен не через put
+    class SteadyClockLatencyTrace {
+    public:
+        typedef LatencyHistogram Histogram;
+
+        SteadyClockLatencyTrace() = default;
+
+        SteadyClockLatencyTrace(const SteadyClockLatencyTrace &other) : stamps_(other.stamps_) {}
+
+        SteadyClockLatencyTrace &operator=(const SteadyClockLatencyTrace &other) {
+            stamps_ = other.stamps_;
+            return *this;
+        }
+
+        void resize(size_t capacity) {
+            stamps_.assign(capacity, 0);
+        }
+
+        void relocate(size_t old_beg, size_t size, size_t old_capacity, size_t new_capacity) {
+            std::vector<uint64_t> stamps(new_capacity, 0);
+            for (size_t i = 0; i < size and old_capacity != 0; i++) {
+                stamps[i] = stamps_[(old_beg + i) % old_capacity];
+            }
+            stamps_.swap(stamps);
+        }
+
+        void stamp(size_t slot) {
+            stamps_[slot] = now();
+        }
+
+        void stamp(size_t beg, size_t n, size_t capacity) {
+            uint64_t current = now();
+            for (size_t i = 0; i < n; i++) {
+                stamps_[(beg + i) % capacity] = current;
+            }
+        }
+
+        void record(size_t beg, size_t n, size_t capacity) {
+            if (n == 0) {
+                return;
+            }
+            uint64_t current = now();
+            for (size_t i = 0; i < n; i++) {
+                size_t slot = (beg + i) % capacity;
+                if (stamps_[slot] != 0) {
+                    histogram_.record(current - stamps_[slot]);
+                    stamps_[slot] = 0;
+                }
+            }
+        }
+
+        // Метки переезжают вместе с памятью буфера, гистограмма остается у своего буфера
+        void swap_stamps(SteadyClockLatencyTrace &other) {
+            stamps_.swap(other.stamps_);
+        }
+
+        const LatencyHistogram &histogram() const {
+            return histogram_;
+        }
+
+    private:
+        std::vector<uint64_t> stamps_;
+        // гистограмму пишет читатель, поэтому она не делит линию с заголовком stamps_
+        BUFF_CACHE_ALIGNED LatencyHistogram histogram_;
+
+        static uint64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    };
+
+    typedef SteadyClockLatencyTrace LatencyTrace;
+#else
+    typedef NoLatencyTrace LatencyTrace;
+#endif
+}
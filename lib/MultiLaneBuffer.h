@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <initializer_list>
+#include <vector>
+
+#include "CCircularBuffer.h"
+
+namespace buff {
+
+    enum class LaneSchedule {
+        kStrictPriority,
+        kWeightedRoundRobin
+    };
+
+    // Несколько полос CCircularBuffer за одним интерфейсом put(lane, value)/get().
+    // kStrictPriority: всегда читается полоса с наименьшим номером, в которой есть элементы.
+    // kWeightedRoundRobin: полосы обходятся по кругу, за один заход из полосы берется до weight элементов.
+    template<class T, class Allocator = std::allocator<T>>
+    class MultiLaneBuffer {
+    public:
+        typedef T value_type;
+        typedef size_t size_type;
+
+        MultiLaneBuffer(std::initializer_list<size_t> capacities, LaneSchedule schedule = LaneSchedule::kStrictPriority)
+                : schedule_(schedule), weights_(capacities.size(), 1) {
+            lanes_.reserve(capacities.size());
+            for (size_t capacity: capacities) {
+                lanes_.emplace_back(capacity);
+            }
+            credit_ = weights_.empty() ? 0 : weights_[0];
+        }
+
+        size_t lanes() const {
+            return lanes_.size();
+        }
+
+        const CCircularBuffer<T, Allocator> &lane(size_t index) const {
+            return lanes_[index];
+        }
+
+        void set_weight(size_t lane, size_t weight) {
+            weights_[lane] = weight == 0 ? 1 : weight;
+            if (lane == current_) {
+                credit_ = weights_[lane];
+            }
+        }
+
+        size_t size() const {
+            size_t ret = 0;
+            for (const CCircularBuffer<T, Allocator> &lane: lanes_) {
+                ret += lane.size();
+            }
+            return ret;
+        }
+
+        bool empty() const {
+            for (const CCircularBuffer<T, Allocator> &lane: lanes_) {
+                if (!lane.empty()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void put(size_t lane, const T &value) {
+            lanes_[lane].put(value);
+        }
+
+        T get() {
+            T ret = T();
+            get_batch(&ret, 1);
+            return ret;
+        }
+
+        // Забирает до max элементов в порядке расписания, копируя их из полос сегментами
+        template<class OutputIterator>
+        size_t get_batch(OutputIterator out, size_t max) {
+            size_t taken = 0;
+            while (taken < max) {
+                size_t lane = next_lane();
+                if (lane == lanes_.size()) {
+                    break;
+                }
+                size_t want = max - taken;
+                if (schedule_ == LaneSchedule::kWeightedRoundRobin and credit_ < want) {
+                    want = credit_;
+                }
+                size_t count = take(lanes_[lane], out, want);
+                taken += count;
+                if (schedule_ == LaneSchedule::kWeightedRoundRobin) {
+                    credit_ -= count;
+                }
+            }
+            return taken;
+        }
+
+    private:
+        LaneSchedule schedule_;
+        std::vector<CCircularBuffer<T, Allocator>> lanes_;
+        std::vector<size_t> weights_;
+        size_t current_ = 0;
+        size_t credit_ = 0;
+
+        // Номер полосы, из которой читать дальше, или lanes_.size(), если все пусты
+        size_t next_lane() {
+            if (lanes_.empty()) {
+                return 0;
+            }
+            if (schedule_ == LaneSchedule::kStrictPriority) {
+                for (size_t i = 0; i < lanes_.size(); i++) {
+                    if (!lanes_[i].empty()) {
+                        return i;
+                    }
+                }
+                return lanes_.size();
+            }
+            for (size_t step = 0; step <= lanes_.size(); step++) {
+                if (credit_ > 0 and !lanes_[current_].empty()) {
+                    return current_;
+                }
+                current_ = (current_ + 1) % lanes_.size();
+                credit_ = weights_[current_];
+            }
+            return lanes_.size();
+        }
+
+        template<class OutputIterator>
+        static size_t take(CCircularBuffer<T, Allocator> &lane, OutputIterator &out, size_t max) {
+            size_t taken = 0;
+            while (taken < max and !lane.empty()) {
+                size_t count = std::min(lane.peek_size(), max - taken);
+                out = std::copy(lane.peek(), lane.peek() + count, out);
+                lane.release(count);
+                taken += count;
+            }
+            return taken;
+        }
+    };
+}
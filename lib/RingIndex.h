@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+
+namespace buff::detail {
+
+    constexpr size_t next_index(size_t index, size_t capacity) {
+        return index + 1 == capacity ? 0 : index + 1;
+    }
+
+    constexpr size_t ring_index(size_t beg, size_t offset, size_t capacity) {
+        return (beg + offset) % capacity;
+    }
+
+    constexpr size_t ring_size(size_t beg, size_t end, size_t capacity, bool empty) {
+        if (end > beg) {
+            return end - beg;
+        } else if (end < beg) {
+            return capacity - beg + end;
+        } else if (empty) {
+            return 0;
+        } else {
+            return capacity;
+        }
+    }
+
+    constexpr size_t contiguous_size(size_t beg, size_t end, size_t capacity, bool empty) {
+        if (empty) {
+            return 0;
+        }
+        if (end > beg) {
+            return end - beg;
+        }
+        return capacity - beg;
+    }
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "CacheAligned.h"
+#include "ConcurrentCircularBuffer.h"
+
+#if defined(__linux__) && __has_include(<sched.h>)
+#define BUFF_HAS_SCHED_GETCPU 1
+#include <sched.h>
+#endif
+
+namespace buff {
+
+    // Набор независимых ConcurrentCircularBuffer (по одному на ядро или NUMA-узел), чтобы писатели
+    // не сходились на одном мьютексе. Писатель выбирает шард по ключу или по ядру, на котором работает;
+    // читатель разбирает шарды по отдельности или, если буфер создан с merged, сливает их примерно
+    // в порядке времени put (тогда каждый put читает часы).
+    template<class T, class Allocator = std::allocator<T>>
+    class ShardedCircularBuffer {
+        struct Entry {
+            uint64_t stamp;
+            T value;
+        };
+
+        typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Entry> EntryAllocator;
+
+        // Каждый шард на своих кэш-линиях
+        struct alignas(kCacheLineSize) Shard {
+            explicit Shard(size_t capacity) : ring(capacity) {}
+
+            ConcurrentCircularBuffer<Entry, EntryAllocator> ring;
+        };
+
+    public:
+        typedef T value_type;
+        typedef size_t size_type;
+
+        // shards == 0 - по числу аппаратных потоков; merged - ставить метки времени для try_get_merged
+        ShardedCircularBuffer(size_t shards, size_t shard_capacity, bool merged = false) : merged_(merged) {
+            if (shards == 0) {
+                shards = std::thread::hardware_concurrency();
+            }
+            if (shards == 0) {
+                shards = 1;
+            }
+            shards_.reserve(shards);
+            for (size_t i = 0; i < shards; i++) {
+                shards_.push_back(std::make_unique<Shard>(shard_capacity));
+            }
+        }
+
+        size_t shards() const {
+            return shards_.size();
+        }
+
+        size_t shard_capacity() const {
+            return shards_[0]->ring.capacity();
+        }
+
+        size_t size() const {
+            size_t ret = 0;
+            for (const std::unique_ptr<Shard> &shard: shards_) {
+                ret += shard->ring.size();
+            }
+            return ret;
+        }
+
+        size_t size(size_t shard) const {
+            return shards_[shard]->ring.size();
+        }
+
+        bool empty() const {
+            for (const std::unique_ptr<Shard> &shard: shards_) {
+                if (!shard->ring.empty()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        template<class Key>
+        size_t shard_for(const Key &key) const {
+            return std::hash<Key>()(key) % shards_.size();
+        }
+
+        // Шард ядра, на котором сейчас работает поток (без sched_getcpu - шард потока)
+        size_t local_shard() const {
+#ifdef BUFF_HAS_SCHED_GETCPU
+            int cpu = sched_getcpu();
+            if (cpu >= 0) {
+                return static_cast<size_t>(cpu) % shards_.size();
+            }
+#endif
+            return shard_for(std::this_thread::get_id());
+        }
+
+        bool try_put(size_t shard, const T &value) {
+            return shards_[shard]->ring.try_put(Entry{merged_ ? now() : 0, value});
+        }
+
+        bool try_put(const T &value) {
+            return try_put(local_shard(), value);
+        }
+
+        template<class Key>
+        bool try_put_by_key(const Key &key, const T &value) {
+            return try_put(shard_for(key), value);
+        }
+
+        bool try_get(size_t shard, T &value) {
+            Entry entry;
+            if (!shards_[shard]->ring.try_get(entry)) {
+                return false;
+            }
+            value = std::move(entry.value);
+            return true;
+        }
+
+        // Забирает самый старый из первых элементов шардов. Порядок приблизительный: метки ставятся
+        // разными потоками без общей синхронизации, а между просмотром шардов и изъятием могут прийти другие.
+        // Без merged меток нет, и забирается первый элемент первого непустого шарда.
+        bool try_get_merged(T &value) {
+            Entry entry;
+            for (;;) {
+                size_t oldest = shards_.size();
+                uint64_t oldest_stamp = std::numeric_limits<uint64_t>::max();
+                for (size_t i = 0; i < shards_.size(); i++) {
+                    if (shards_[i]->ring.try_peek(entry) and entry.stamp < oldest_stamp) {
+                        oldest = i;
+                        oldest_stamp = entry.stamp;
+                    }
+                }
+                if (oldest == shards_.size()) {
+                    return false;
+                }
+                if (shards_[oldest]->ring.try_get(entry)) {
+                    value = std::move(entry.value);
+                    return true;
+                }
+            }
+        }
+
+    private:
+        std::vector<std::unique_ptr<Shard>> shards_;
+        bool merged_;
+
+        static uint64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    };
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "CacheAligned.h"
+
+namespace buff {
+
+    // Перезаписываемое кольцо с одним писателем, из которого другие потоки в любой момент снимают копию
+    // содержимого, не останавливая писателя. Слоты хранятся атомарными словами: писатель пишет их
+    // release-записями, читатель копирует acquire-чтениями в принадлежащий ему Snapshot (после первого раза
+    // без выделения памяти) и проверяет копию по счетчикам писателя, как в seqlock: элементы, которые
+    // писатель успел перезаписать за время копирования, отбрасываются с головы, поэтому в снимке всегда
+    // непрерывный отрезок последних положенных элементов без разорванных значений.
+    template<class T, class Allocator = std::allocator<T>>
+    class SnapshotCircularBuffer {
+        static_assert(std::is_trivially_copyable<T>::value, "SnapshotCircularBuffer copies elements by words");
+
+        // Самое широкое слово до 8 байт, на которое делится размер T
+        typedef typename std::conditional<sizeof(T) % 8 == 0, uint64_t,
+                typename std::conditional<sizeof(T) % 4 == 0, uint32_t,
+                typename std::conditional<sizeof(T) % 2 == 0, uint16_t, uint8_t>::type>::type>::type Word;
+        typedef typename std::allocator_traits<Allocator>::template rebind_alloc<std::atomic<Word>> WordAllocator;
+
+        static constexpr size_t kWords = sizeof(T) / sizeof(Word);
+
+    public:
+        typedef T value_type;
+        typedef size_t size_type;
+
+        class Snapshot {
+            friend SnapshotCircularBuffer;
+        public:
+            typedef T value_type;
+            typedef const T *const_iterator;
+
+            size_t size() const {
+                return size_;
+            }
+
+            bool empty() const {
+                return size_ == 0;
+            }
+
+            // Порядковый номер (среди всех put) первого элемента снимка
+            uint64_t sequence() const {
+                return sequence_;
+            }
+
+            const T &operator[](size_t idx) const {
+                return data_[offset_ + idx];
+            }
+
+            const_iterator begin() const {
+                return data_.data() + offset_;
+            }
+
+            const_iterator end() const {
+                return begin() + size_;
+            }
+
+        private:
+            std::vector<T> data_;
+            size_t offset_ = 0;
+            size_t size_ = 0;
+            uint64_t sequence_ = 0;
+        };
+
+        explicit SnapshotCircularBuffer(size_t capacity) : capacity_(capacity) {
+            mass = std::allocator_traits<WordAllocator>::allocate(allocator_, capacity_ * kWords);
+            Word words[kWords];
+            T value{};
+            std::memcpy(words, &value, sizeof(T));
+            for (size_t i = 0; i < capacity_; i++) {
+                for (size_t w = 0; w < kWords; w++) {
+                    std::allocator_traits<WordAllocator>::construct(allocator_, mass + i * kWords + w, words[w]);
+                }
+            }
+        }
+
+        SnapshotCircularBuffer(const SnapshotCircularBuffer &) = delete;
+
+        SnapshotCircularBuffer &operator=(const SnapshotCircularBuffer &) = delete;
+
+        ~SnapshotCircularBuffer() {
+            std::allocator_traits<WordAllocator>::deallocate(allocator_, mass, capacity_ * kWords);
+        }
+
+        size_t capacity() const {
+            return capacity_;
+        }
+
+        size_t size() const {
+            uint64_t head = head_.load(std::memory_order_acquire);
+            return head < capacity_ ? head : capacity_;
+        }
+
+        // Только из потока писателя
+        void put(const T &value) {
+            if (capacity_ == 0) {
+                return;
+            }
+            uint64_t head = head_.load(std::memory_order_relaxed);
+            started_.store(head + 1, std::memory_order_relaxed);
+            // release-записи слов не дают started_ отстать от них: читатель, увидевший новое слово, увидит и started_
+            Word words[kWords];
+            std::memcpy(words, &value, sizeof(T));
+            std::atomic<Word> *slot = mass + (head % capacity_) * kWords;
+            for (size_t w = 0; w < kWords; w++) {
+                slot[w].store(words[w], std::memory_order_release);
+            }
+            head_.store(head + 1, std::memory_order_release);
+        }
+
+        // Копирует содержимое в snapshot, переиспользуя его память; можно звать из любого числа потоков
+        void snapshot(Snapshot &out) const {
+            if (out.data_.size() < capacity_) {
+                out.data_.resize(capacity_);
+            }
+            uint64_t head = head_.load(std::memory_order_acquire);
+            uint64_t from = head > capacity_ ? head - capacity_ : 0;
+            size_t count = head - from;
+            Word words[kWords];
+            for (size_t i = 0; i < count; i++) {
+                const std::atomic<Word> *slot = mass + ((from + i) % capacity_) * kWords;
+                for (size_t w = 0; w < kWords; w++) {
+                    words[w] = slot[w].load(std::memory_order_acquire);
+                }
+                std::memcpy(out.data_.data() + i, words, sizeof(T));
+            }
+            // acquire-чтения слов не дают started_ прочитаться раньше них
+            uint64_t started = started_.load(std::memory_order_relaxed);
+
+            // писатель, начавший элемент started - 1, уже портит слот элемента started - 1 - capacity_
+            uint64_t valid = started > capacity_ ? started - capacity_ : 0;
+            if (valid > head) {
+                valid = head;
+            }
+            if (valid < from) {
+                valid = from;
+            }
+            out.offset_ = valid - from;
+            out.size_ = head - valid;
+            out.sequence_ = valid;
+        }
+
+        Snapshot snapshot() const {
+            Snapshot ret;
+            snapshot(ret);
+            return ret;
+        }
+
+    private:
+        std::atomic<Word> *mass;
+        size_t capacity_;
+        WordAllocator allocator_;
+        alignas(kCacheLineSize) std::atomic<uint64_t> started_{0};
+        std::atomic<uint64_t> head_{0};
+    };
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "CCircularBufferFwd.h"
+#include "RingIndex.h"
+
+namespace buff {
+
+    // Буфер фиксированной емкости N без динамической памяти, пригоден для вычислений на этапе компиляции
+    template<class T, size_t N>
+    class StaticCircularBuffer {
+    public:
+        typedef T value_type;
+        typedef value_type *pointer;
+        typedef const value_type *const_pointer;
+        typedef value_type &reference;
+        typedef const value_type &const_reference;
+        typedef size_t size_type;
+
+        constexpr StaticCircularBuffer() = default;
+
+        constexpr StaticCircularBuffer(std::initializer_list<value_type> list) {
+            for (const value_type &value: list) {
+                put(value);
+            }
+        }
+
+        constexpr size_type size() const {
+            return detail::ring_size(beg_index, end_index, N, empty_);
+        }
+
+        constexpr size_type capacity() const {
+            return N;
+        }
+
+        constexpr bool empty() const {
+            return empty_;
+        }
+
+        constexpr void put(const T &value) {
+            if (N == 0) {
+                return;
+            }
+            if (!empty_ and end_index == beg_index) {
+                beg_index = detail::next_index(beg_index, N);
+            }
+            mass[end_index] = value;
+            end_index = detail::next_index(end_index, N);
+            empty_ = false;
+        }
+
+        constexpr T get() {
+            if (empty_) {
+                return T();
+            }
+            T ret = mass[beg_index];
+            beg_index = detail::next_index(beg_index, N);
+            if (beg_index == end_index) {
+                empty_ = true;
+            }
+            return ret;
+        }
+
+        constexpr void clear() {
+            beg_index = 0;
+            end_index = 0;
+            empty_ = true;
+        }
+
+        constexpr const T &front() const {
+            return mass[beg_index];
+        }
+
+        constexpr const T &back() const {
+            if (end_index == 0) {
+                return mass[N - 1];
+            }
+            return mass[end_index - 1];
+        }
+
+        constexpr reference operator[](size_type idx) {
+            return mass[detail::ring_index(beg_index, idx, N)];
+        }
+
+        constexpr const_reference operator[](size_type idx) const {
+            return mass[detail::ring_index(beg_index, idx, N)];
+        }
+
+    private:
+        std::array<T, N> mass{};
+        size_t end_index = 0;
+        size_t beg_index = 0;
+        bool empty_ = true;
+    };
+}
@@ -1,8 +1,29 @@
 #include <lib/CCircularBuffer.h>
+#include <lib/CacheAlignedAllocator.h>
+#include <lib/LatencyHistogram.h>
+#include <lib/StaticCircularBuffer.h>
+#include <lib/BroadcastRing.h>
+#include <lib/CompressedCircularBuffer.h>
+#include <lib/ConcurrentCircularBuffer.h>
+#include <lib/MultiLaneBuffer.h>
+#include <lib/ShardedCircularBuffer.h>
+#include <lib/SnapshotCircularBuffer.h>
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <execution>
+#include <numeric>
 #include <sstream>
+#include <thread>
 #include <vector>
 
+#ifdef __linux__
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 using namespace buff;
 
 template<class T>
@@ -49,6 +70,38 @@ protected:
     pointer array;
 };
 
+// Аллокатор, который отказывает в выделениях больше limit элементов, как исчерпанная память
+template<class T>
+struct LimitedAllocator {
+    typedef T value_type;
+
+    static inline size_t limit = 1024;
+
+    LimitedAllocator() = default;
+
+    template<class U>
+    LimitedAllocator(const LimitedAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        if (n > limit) {
+            throw std::bad_alloc();
+        }
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T *p, size_t n) {
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    bool operator==(const LimitedAllocator &) const {
+        return true;
+    }
+
+    bool operator!=(const LimitedAllocator &) const {
+        return false;
+    }
+};
+
 TEST(CCircularBufferTestSuite, EmptyTest) {
     CCircularBuffer<int> bufer;
 
@@ -220,6 +273,383 @@ TEST(CCircularBufferTestSuite, SwapTest) {
 
     swap(bufer2, anotherBufer2);
     ASSERT_TRUE(bufer2 == bufer && anotherBufer2 == anotherBufer);
+
+    // обмен памятью, а не копирование элементов
+    const int *storage = &bufer2.front();
+    const int *another_storage = &anotherBufer2.front();
+    swap(bufer2, anotherBufer2);
+    ASSERT_TRUE(&bufer2.front() == another_storage && &anotherBufer2.front() == storage);
+    std::swap(bufer2, anotherBufer2);
+    ASSERT_TRUE(&bufer2.front() == storage && &anotherBufer2.front() == another_storage);
+
+    CCircularBuffer<int> moved(std::move(bufer2));
+    ASSERT_TRUE(&moved.front() == storage && moved == bufer);
+}
+
+TEST(CCircularBufferTestSuite, AssignTest) {
+    CCircularBuffer<int> bufer(4);
+    for (int i = 0; i < 6; i++) {
+        bufer.put(i); // начало буфера не в нулевом слоте
+    }
+    CCircularBuffer<int> copy(4);
+    copy.put(100);
+    const int *storage = copy.segments().first.data;
+    copy = bufer;
+    ASSERT_TRUE(copy.segments().first.data == storage); // емкости совпали, память переиспользована
+    ASSERT_TRUE(copy == bufer && copy.size() == 4 && copy[0] == 2 && copy[3] == 5);
+
+    CCircularBuffer<int> shifted(4);
+    shifted.put(-1);
+    shifted.get();
+    for (int i = 2; i < 6; i++) {
+        shifted.put(i);
+    }
+    ASSERT_TRUE(shifted == bufer); // сегменты буферов разбиты по-разному
+    shifted.put(6);
+    ASSERT_TRUE(shifted != bufer);
+
+    CCircularBuffer<std::string> strings(3);
+    for (std::string value: {"a", "b", "c", "d"}) {
+        strings.put(value);
+    }
+    CCircularBuffer<std::string> other(2);
+    other = strings;
+    ASSERT_TRUE(other.capacity() == 3 && other == strings && other.front() == "b");
+    other = other;
+    ASSERT_TRUE(other == strings);
+
+    CCircularBuffer<std::string> copied(strings);
+    ASSERT_TRUE(copied == strings);
+
+    CCircularBuffer<int, LimitedAllocator<int>> limited{1, 2};
+    CCircularBuffer<int, LimitedAllocator<int>> larger{3, 4, 5};
+    LimitedAllocator<int>::limit = 2;
+    ASSERT_THROW(limited = larger, std::bad_alloc);
+    LimitedAllocator<int>::limit = 1024;
+    ASSERT_TRUE(limited.capacity() == 2 && limited.front() == 1 && limited.back() == 2); // буфер не тронут
+
+    const std::string *left = strings.segments().first.data;
+    const std::string *right = other.segments().first.data;
+    strings.swap(other);
+    ASSERT_TRUE(strings.segments().first.data == right && other.segments().first.data == left); // без копирования
+}
+
+TEST(CCircularBufferTestSuite, ReserveCommitTest) {
+    struct Order {
+        uint64_t id;
+        char payload[504];
+    };
+
+    CCircularBuffer<Order> bufer(3);
+    for (uint64_t i = 0; i < 5; i++) {
+        Order *slot = bufer.reserve_slot();
+        slot->id = i;
+        bufer.commit();
+    }
+
+    ASSERT_TRUE(bufer.size() == 3);
+    ASSERT_TRUE(bufer.front().id == 2);
+    ASSERT_TRUE(bufer.back().id == 4);
+
+    CCircularBuffer<Order> empty_bufer;
+    ASSERT_TRUE(empty_bufer.reserve_slot() == nullptr);
+}
+
+TEST(CCircularBufferTestSuite, PeekReleaseTest) {
+    CCircularBuffer<int> bufer{1, 2, 3, 4, 5};
+    bufer.put(6);
+    bufer.put(7);
+
+    ASSERT_TRUE(*bufer.peek() == 3);
+    ASSERT_TRUE(bufer.peek_size() == 3);
+
+    bufer.release(3);
+    ASSERT_TRUE(*bufer.peek() == 6);
+    ASSERT_TRUE(bufer.peek_size() == 2);
+
+    bufer.release(100); // проверка на то, что программа не упадет
+    ASSERT_TRUE(bufer.empty());
+    ASSERT_TRUE(bufer.peek() == nullptr);
+    ASSERT_TRUE(bufer.peek_size() == 0);
+
+    bufer.put(8);
+    ASSERT_TRUE(bufer.get() == 8);
+}
+
+TEST(CCircularBufferTestSuite, CacheAlignedTest) {
+    CCircularBuffer<int, CacheAlignedAllocator<int>> bufer(10);
+    bufer.put(1);
+    bufer.put(2);
+
+    ASSERT_TRUE(reinterpret_cast<uintptr_t>(bufer.peek()) % kCacheLineSize == 0);
+    ASSERT_TRUE(*(bufer.begin() + 1) == 2);
+
+    CCircularBuffer<char, CacheAlignedAllocator<char>> huge_bufer(kHugePageSize);
+    huge_bufer.put('a');
+    ASSERT_TRUE(reinterpret_cast<uintptr_t>(huge_bufer.peek()) % kHugePageSize == 0);
+
+    CCircularBuffer<CacheLinePadded<int>, CacheAlignedAllocator<CacheLinePadded<int>>> padded(4);
+    padded.put(1);
+    padded.put(2);
+    ASSERT_TRUE(sizeof(CacheLinePadded<int>) == kCacheLineSize);
+    ASSERT_TRUE(reinterpret_cast<uintptr_t>(&padded.back()) % kCacheLineSize == 0);
+    ASSERT_TRUE(padded.get().value == 1);
+}
+
+TEST(CCircularBufferTestSuite, StatsTest) {
+    CCircularBuffer<int> bufer(4);
+    for (int i = 0; i < 6; i++) {
+        bufer.put(i);
+    }
+    bufer.get();
+    bufer.release(10);
+    bufer.get();
+
+    BufferStatsSnapshot stats = bufer.stats();
+#ifdef BUFF_ENABLE_STATS
+    ASSERT_TRUE(stats.puts == 6);
+    ASSERT_TRUE(stats.gets == 4);
+    ASSERT_TRUE(stats.empty_gets == 1);
+    ASSERT_TRUE(stats.overwrites == 2);
+    ASSERT_TRUE(stats.high_water_mark == 4);
+    ASSERT_TRUE(stats.occupancy[1] == 1 && stats.occupancy[kOccupancyBuckets - 1] == 3);
+#else
+    ASSERT_TRUE(stats.puts == 0 && stats.gets == 0 && stats.overwrites == 0);
+#endif
+
+    CCircularBufferExt<int> array;
+    for (int i = 0; i < 5; i++) {
+        array.put(i);
+    }
+#ifdef BUFF_ENABLE_STATS
+    ASSERT_TRUE(array.stats().reallocations == 4);
+#else
+    ASSERT_TRUE(array.stats().reallocations == 0);
+#endif
+}
+
+TEST(CCircularBufferTestSuite, LatencyTest) {
+    LatencyHistogram histogram;
+    for (uint64_t i = 1; i <= 1000; i++) {
+        histogram.record(i * 1000);
+    }
+    ASSERT_TRUE(histogram.count() == 1000);
+    ASSERT_TRUE(histogram.max() == 1000000);
+    ASSERT_TRUE(histogram.value_at_percentile(50) >= 500000 && histogram.value_at_percentile(50) <= 540000);
+    ASSERT_TRUE(histogram.value_at_percentile(100) == 1000000);
+
+    CCircularBuffer<int> bufer(4);
+    bufer.put(1);
+    bufer.put(2);
+    bufer.get();
+    bufer.release(1);
+
+    CCircularBufferExt<int> array;
+    for (int i = 0; i < 5; i++) {
+        array.put(i);
+    }
+    array.release(5);
+#ifdef BUFF_ENABLE_LATENCY_TRACE
+    ASSERT_TRUE(bufer.latency().count() == 2);
+    ASSERT_TRUE(array.latency().count() == 5);
+#else
+    ASSERT_TRUE(bufer.latency().count() == 0);
+    ASSERT_TRUE(array.latency().count() == 0);
+#endif
+}
+
+constexpr StaticCircularBuffer<int, 4> MakeSquares() {
+    StaticCircularBuffer<int, 4> squares;
+    for (int i = 0; i < 6; i++) {
+        squares.put(i * i);
+    }
+    return squares;
+}
+
+TEST(CCircularBufferTestSuite, ConstexprTest) {
+    constexpr StaticCircularBuffer<int, 4> squares = MakeSquares();
+    static_assert(squares.size() == 4);
+    static_assert(squares.front() == 4 && squares.back() == 25);
+    static_assert(squares[1] == 9);
+
+    constexpr StaticCircularBuffer<int, 3> list{1, 2, 3, 4};
+    static_assert(list[0] == 2 && list.capacity() == 3);
+
+    StaticCircularBuffer<int, 2> bufer;
+    bufer.put(1);
+    ASSERT_TRUE(bufer.get() == 1);
+    ASSERT_TRUE(bufer.empty());
+
+    static_assert(detail::ring_size(3, 1, 4, false) == 2);
+    static_assert(detail::next_index(3, 4) == 0);
+
+#if defined(__cpp_lib_constexpr_dynamic_alloc) && defined(__cpp_constexpr_dynamic_alloc) && \
+    !defined(BUFF_ENABLE_STATS) && !defined(BUFF_ENABLE_LATENCY_TRACE)
+    constexpr int sum = [] {
+        CCircularBuffer<int> ring(3);
+        for (int i = 1; i <= 5; i++) {
+            ring.put(i);
+        }
+        return ring.get() + ring[0] + ring.back();
+    }();
+    static_assert(sum == 3 + 4 + 5);
+#endif
+}
+
+TEST(CCircularBufferTestSuite, RandomAccessIteratorTest) {
+    CCircularBuffer<int> bufer(5);
+    for (int i = 1; i <= 7; i++) {
+        bufer.put(i);
+    }
+
+    auto first = bufer.begin();
+    ASSERT_TRUE(first[2] == 5);
+    ASSERT_TRUE(*(2 + first) == 5);
+    ASSERT_TRUE(bufer.end() - first == 5);
+    ASSERT_TRUE(*(bufer.end() - 1) == 7);
+
+    std::sort(bufer.begin(), bufer.end(), std::greater<int>());
+    ASSERT_TRUE(bufer.front() == 7 && bufer.back() == 3);
+
+    const CCircularBuffer<int> &const_bufer = bufer;
+    ConstIterator<int> it = bufer.begin();
+    ASSERT_TRUE(it == const_bufer.begin());
+    ASSERT_TRUE(std::is_sorted(const_bufer.rcbegin(), const_bufer.rcend()));
+
+    static_assert(std::is_same_v<std::iterator_traits<ConstIterator<int>>::reference, const int &>);
+    static_assert(std::is_same_v<decltype(++it), ConstIterator<int> &>);
+    static_assert(std::is_convertible_v<Iterator<int>, ConstIterator<int>>);
+    static_assert(!std::is_convertible_v<ConstIterator<int>, Iterator<int>>); // константный буфер не изменить
+    ASSERT_TRUE(bufer.begin() == it && it != bufer.end() && bufer.end() - it == 5);
+
+    CCircularBuffer<std::pair<int, int>, CacheAlignedAllocator<std::pair<int, int>>> pairs(2);
+    pairs.put({1, 2});
+    ASSERT_TRUE((pairs.begin() + 0)->second == 2);
+}
+
+TEST(CCircularBufferTestSuite, ParallelTest) {
+    CCircularBuffer<int64_t> bufer(100000);
+    for (int64_t i = 0; i < 150000; i++) {
+        bufer.put(i);
+    }
+    int64_t expected = 0;
+    for (int64_t i = 50000; i < 150000; i++) {
+        expected += 2 * i;
+    }
+
+    std::for_each(std::execution::par, bufer.begin(), bufer.end(), [](int64_t &value) { value *= 2; });
+    ASSERT_TRUE(std::reduce(std::execution::par, bufer.cbegin(), bufer.cend(), int64_t(0)) == expected);
+
+    const size_t parts = 4;
+    std::vector<int64_t> sums(parts, 0);
+    std::vector<std::thread> threads;
+    for (size_t part = 0; part < parts; part++) {
+        threads.emplace_back([&bufer, &sums, part, parts] {
+            auto segments = bufer.partition(part, parts);
+            sums[part] = std::accumulate(segments.first.begin(), segments.first.end(), int64_t(0)) +
+                         std::accumulate(segments.second.begin(), segments.second.end(), int64_t(0));
+        });
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    ASSERT_TRUE(std::accumulate(sums.begin(), sums.end(), int64_t(0)) == expected);
+    auto none = bufer.partition(0, 0);
+    ASSERT_TRUE(none.first.size == 0 && none.second.size == 0);
+    ASSERT_TRUE(bufer.partition(parts, parts).first.size == 0);
+
+    auto segments = bufer.segments();
+    ASSERT_TRUE(segments.first.size == 50000 && segments.second.size == 50000);
+    ASSERT_TRUE(*segments.first.data == 100000);
+}
+
+#ifdef BUFF_HAS_UIO
+TEST(CCircularBufferTestSuite, FdTest) {
+    int pipe_fds[2];
+    ASSERT_TRUE(pipe(pipe_fds) == 0);
+
+    CCircularBuffer<char> bufer(8);
+    for (char c: std::string("xxxxxab")) {
+        bufer.put(c);
+    }
+    bufer.release(5);
+
+    ASSERT_TRUE(write(pipe_fds[1], "cdefghijk", 9) == 9);
+    ASSERT_TRUE(bufer.read_from_fd(pipe_fds[0]) == 6); // свободные 6 байт в двух сегментах
+    ASSERT_TRUE(bufer.size() == 8);
+    ASSERT_TRUE(std::string(bufer.begin(), bufer.end()) == "abcdefgh");
+    ASSERT_TRUE(bufer.read_from_fd(pipe_fds[0]) == -1 && errno == ENOBUFS);
+
+    ASSERT_TRUE(bufer.write_to_fd(pipe_fds[1]) == 8);
+    ASSERT_TRUE(bufer.empty());
+
+    char out[16] = {};
+    ASSERT_TRUE(read(pipe_fds[0], out, sizeof(out)) == 11);
+    ASSERT_TRUE(std::string(out, 11) == "ijkabcdefgh");
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    int sockets[2];
+    ASSERT_TRUE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    CCircularBufferExt<char> proxy(5);
+    ASSERT_TRUE(write(sockets[0], "hello", 5) == 5);
+    ASSERT_TRUE(proxy.read_from_fd(sockets[1]) == 5);
+    ASSERT_TRUE(proxy.write_to_fd(sockets[1]) == 5);
+    ASSERT_TRUE(read(sockets[0], out, sizeof(out)) == 5 && std::string(out, 5) == "hello");
+    close(sockets[0]);
+    close(sockets[1]);
+}
+#endif
+
+TEST(CCircularBufferTestSuite, SaveLoadTest) {
+    CCircularBuffer<int> bufer(5);
+    for (int i = 0; i < 8; i++) {
+        bufer.put(i);
+    }
+    std::stringstream stream;
+    ASSERT_TRUE(bufer.save(stream));
+
+    CCircularBufferExt<int> copy(2);
+    ASSERT_TRUE(copy.load(stream));
+    ASSERT_TRUE(copy.capacity() == 5 && copy.size() == 5);
+    ASSERT_TRUE(copy.peek_size() == 5); // после загрузки буфер линейный
+    for (int i = 0; i < 5; i++) {
+        ASSERT_TRUE(copy[i] == i + 3);
+    }
+    copy.put(8);
+    ASSERT_TRUE(copy.size() == 6 && copy.back() == 8);
+
+    CCircularBuffer<int> empty(3);
+    std::stringstream empty_stream;
+    ASSERT_TRUE(empty.save(empty_stream));
+    ASSERT_TRUE(bufer.load(empty_stream));
+    ASSERT_TRUE(bufer.empty() && bufer.capacity() == 3);
+
+    std::stringstream wrong("not a buffer image at all, definitely");
+    ASSERT_FALSE(bufer.load(wrong));
+
+    std::stringstream wrong_type;
+    CCircularBuffer<char>(4, 'a').save(wrong_type);
+    ASSERT_FALSE(bufer.load(wrong_type));
+
+    CCircularBuffer<int> traced(3);
+    traced.put(1);
+    std::stringstream image;
+    CCircularBuffer<int>(3, 5).save(image);
+    ASSERT_TRUE(traced.load(image) && traced.size() == 3);
+    traced.release(3);
+    ASSERT_TRUE(traced.latency().count() == 0); // у загруженных элементов нет меток времени
+
+    // заголовок проходит проверки, но памяти под такую емкость нет: буфер должен остаться прежним
+    std::string bogus = image.str();
+    detail::ImageHeader header;
+    std::memcpy(&header, bogus.data(), sizeof(header));
+    header.capacity = uint64_t(1) << 40;
+    std::memcpy(&bogus[0], &header, sizeof(header));
+    std::stringstream bogus_stream(bogus);
+    CCircularBuffer<int, LimitedAllocator<int>> untouched{1, 2};
+    ASSERT_FALSE(untouched.load(bogus_stream));
+    ASSERT_TRUE(untouched.capacity() == 2 && untouched.size() == 2 && untouched[1] == 2);
 }
 
 TEST(CCircularBufferExtTestSuite, EmptyTest) {
@@ -283,6 +713,16 @@ TEST(CCircularBufferExtTestSuite, SwapTest) {
 
     swap(bufer2, anotherBufer2);
     ASSERT_TRUE(bufer2 == bufer && anotherBufer2 == anotherBufer);
+
+    const int *storage = &bufer2.front();
+    swap(bufer2, anotherBufer2);
+    ASSERT_TRUE(&anotherBufer2.front() == storage);
+
+    CCircularBufferExt<int> moved;
+    moved = std::move(anotherBufer2);
+    ASSERT_TRUE(&moved.front() == storage && moved == bufer);
+    moved.put(6);
+    ASSERT_TRUE(moved.size() == 6 && moved.back() == 6);
 }
 
 TEST(CCircularBufferExtTestSuite, PutTest) {
@@ -305,6 +745,28 @@ TEST(CCircularBufferExtTestSuite, PutTest) {
     ASSERT_TRUE(array.capacity() == 12);
 }
 
+TEST(CCircularBufferExtTestSuite, WrappedGrowTest) {
+    CCircularBufferExt<int> array;
+    for (int i = 1; i <= 4; i++) {
+        array.put(i);
+    }
+    array.get();
+    array.put(5);
+    array.put(6);
+    CCircularBufferExt<int> answer{2, 3, 4, 5, 6};
+    ASSERT_TRUE(array == answer);
+    ASSERT_TRUE(array.capacity() == 8);
+
+    CCircularBufferExt<std::string> strings;
+    for (int i = 1; i <= 4; i++) {
+        strings.put(std::string(i, 'a'));
+    }
+    strings.get();
+    strings.put("b");
+    strings.put("c");
+    ASSERT_TRUE(strings.size() == 5 && strings.front() == "aa" && strings.back() == "c");
+}
+
 TEST(CCircularBufferExtTestSuite, ResizeTest) {
     CCircularBufferExt<int> array{1, 2, 3, 4, 5, 6, 7, 8, 0, 10};
 
@@ -336,3 +798,460 @@ TEST(CCircularBufferExtTestSuite, VectorTest) {
 
     ASSERT_TRUE(array.front() == a);
 }
+
+TEST(CCircularBufferExtTestSuite, ReserveCommitTest) {
+    CCircularBufferExt<std::string> array;
+
+    for (int i = 0; i < 5; i++) {
+        new(array.reserve_slot()) std::string(i + 1, 'a');
+        array.commit();
+    }
+
+    ASSERT_TRUE(array.size() == 5);
+    ASSERT_TRUE(array.capacity() == 8);
+    ASSERT_TRUE(*array.peek() == "a");
+
+    array.release(4);
+    ASSERT_TRUE(array.size() == 1);
+    ASSERT_TRUE(array.front() == "aaaaa");
+}
+
+TEST(BroadcastRingTestSuite, PutGetTest) {
+    BroadcastRing<std::string> ring(2, 2);
+    std::string value;
+
+    ASSERT_TRUE(ring.try_put("a"));
+    ASSERT_TRUE(ring.try_put("b"));
+    ASSERT_FALSE(ring.try_put("c"));
+
+    ASSERT_TRUE(ring.try_get(0, value) && value == "a");
+    ASSERT_FALSE(ring.try_put("c")); // второй читатель еще не прочитал "a"
+
+    ASSERT_TRUE(*ring.peek(1) == "a");
+    ring.release(1);
+    ASSERT_TRUE(ring.try_put("c"));
+
+    ASSERT_TRUE(ring.size(0) == 2 && ring.size(1) == 2);
+    ASSERT_TRUE(ring.try_get(0, value) && value == "b");
+    ASSERT_TRUE(ring.try_get(0, value) && value == "c");
+    ASSERT_FALSE(ring.try_get(0, value));
+    ASSERT_TRUE(ring.peek(0) == nullptr);
+    ring.release(0); // читать нечего, курсор остается на месте
+    ASSERT_TRUE(ring.size(0) == 0 && ring.peek(0) == nullptr);
+
+    BroadcastRing<int> empty(4, 1);
+    empty.release(0);
+    ASSERT_TRUE(empty.size(0) == 0 && empty.peek(0) == nullptr);
+    ASSERT_TRUE(empty.try_put(1) && empty.size(0) == 1 && *empty.peek(0) == 1);
+
+    ring.release(1);
+    ring.release(1);
+    std::string *slot = ring.reserve_slot();
+    ASSERT_TRUE(slot != nullptr && ring.reserve_slot() == slot); // без commit слот не разрушается второй раз
+}
+
+TEST(BroadcastRingTestSuite, ThreadsTest) {
+    const size_t consumers = 3;
+    const uint64_t count = 200000;
+    BroadcastRing<uint64_t> ring(64, consumers);
+    std::vector<uint64_t> sums(consumers, 0);
+    std::vector<char> ordered(consumers, true);
+
+    std::vector<std::thread> threads;
+    for (size_t consumer = 0; consumer < consumers; consumer++) {
+        threads.emplace_back([&, consumer] {
+            uint64_t expected = 0;
+            while (expected < count) {
+                const uint64_t *value = ring.peek(consumer);
+                if (value == nullptr) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                ordered[consumer] = ordered[consumer] && *value == expected;
+                sums[consumer] += *value;
+                ring.release(consumer);
+                ++expected;
+            }
+        });
+    }
+    for (uint64_t i = 0; i < count;) {
+        uint64_t *slot = ring.reserve_slot();
+        if (slot == nullptr) {
+            std::this_thread::yield();
+            continue;
+        }
+        *slot = i++;
+        ring.commit();
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+
+    for (size_t consumer = 0; consumer < consumers; consumer++) {
+        ASSERT_TRUE(ordered[consumer]);
+        ASSERT_TRUE(sums[consumer] == count * (count - 1) / 2);
+    }
+}
+
+TEST(MultiLaneBufferTestSuite, StrictPriorityTest) {
+    MultiLaneBuffer<int> buffer{4, 100};
+
+    for (int i = 0; i < 10; i++) {
+        buffer.put(1, 100 + i);
+    }
+    buffer.put(0, 1);
+    buffer.put(0, 2);
+
+    ASSERT_TRUE(buffer.size() == 12);
+    ASSERT_TRUE(buffer.get() == 1);
+
+    std::vector<int> batch(4);
+    ASSERT_TRUE(buffer.get_batch(batch.begin(), 4) == 4);
+    ASSERT_TRUE(batch == std::vector<int>({2, 100, 101, 102}));
+
+    buffer.put(0, 3);
+    ASSERT_TRUE(buffer.get() == 3);
+    ASSERT_TRUE(buffer.get() == 103);
+}
+
+TEST(MultiLaneBufferTestSuite, WeightedRoundRobinTest) {
+    MultiLaneBuffer<int> buffer({10, 10}, LaneSchedule::kWeightedRoundRobin);
+    buffer.set_weight(0, 1);
+    buffer.set_weight(1, 3);
+
+    for (int i = 0; i < 4; i++) {
+        buffer.put(0, i);
+        buffer.put(1, 10 + i);
+    }
+
+    std::vector<int> out;
+    ASSERT_TRUE(buffer.get_batch(std::back_inserter(out), 100) == 8);
+    ASSERT_TRUE(out == std::vector<int>({0, 10, 11, 12, 1, 13, 2, 3}));
+    ASSERT_TRUE(buffer.empty());
+    ASSERT_TRUE(buffer.get_batch(std::back_inserter(out), 100) == 0); // проверка на то, что программа не упадет
+}
+
+TEST(ConcurrentCircularBufferTestSuite, TryPutGetTest) {
+    ConcurrentCircularBuffer<int> buffer(2);
+    int value = 0;
+
+    ASSERT_FALSE(buffer.try_get(value));
+    ASSERT_TRUE(buffer.try_put(1));
+    ASSERT_TRUE(buffer.try_put(2));
+    ASSERT_FALSE(buffer.try_put(3)); // в отличие от CCircularBuffer не перезаписывает
+    ASSERT_TRUE(buffer.size() == 2);
+
+    ASSERT_TRUE(buffer.try_get(value) && value == 1);
+    ASSERT_TRUE(buffer.try_get(value) && value == 2);
+    ASSERT_TRUE(buffer.empty());
+}
+
+#ifdef BUFF_HAS_EVENTFD
+bool IsReadable(int fd) {
+    pollfd descriptor{fd, POLLIN, 0};
+    return poll(&descriptor, 1, 0) == 1;
+}
+
+TEST(ConcurrentCircularBufferTestSuite, NotificationTest) {
+    ConcurrentCircularBuffer<int> buffer(2);
+    ASSERT_TRUE(buffer.readable_fd() == -1);
+    buffer.enable_notifications();
+    ASSERT_FALSE(IsReadable(buffer.readable_fd()));
+    ASSERT_TRUE(IsReadable(buffer.writable_fd())); // пустой буфер сразу доступен для записи
+    buffer.consume_writable();
+
+    buffer.try_put(1);
+    buffer.try_put(2);
+    ASSERT_TRUE(IsReadable(buffer.readable_fd()));
+    ASSERT_FALSE(IsReadable(buffer.writable_fd()));
+
+    buffer.consume_readable();
+    ASSERT_FALSE(IsReadable(buffer.readable_fd()));
+
+    int value = 0;
+    buffer.try_get(value);
+    buffer.try_get(value);
+    ASSERT_TRUE(IsReadable(buffer.writable_fd()));
+    ASSERT_FALSE(IsReadable(buffer.readable_fd()));
+
+    buffer.try_put(3);
+    ASSERT_TRUE(IsReadable(buffer.readable_fd()));
+
+    ConcurrentCircularBuffer<int> late(2);
+    late.try_put(1);
+    late.enable_notifications(); // читатель подписался, когда данные уже есть
+    ASSERT_TRUE(IsReadable(late.readable_fd()) && IsReadable(late.writable_fd()));
+}
+
+TEST(ConcurrentCircularBufferTestSuite, EpollTest) {
+    const int count = 10000;
+    ConcurrentCircularBuffer<int> buffer(64);
+    buffer.enable_notifications();
+
+    std::thread producer([&buffer] {
+        for (int i = 0; i < count; i++) {
+            while (!buffer.try_put(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, buffer.readable_fd(), &event);
+
+    int expected = 0;
+    bool ordered = true;
+    while (expected < count) {
+        epoll_event ready{};
+        epoll_wait(epoll, &ready, 1, 1000);
+        buffer.consume_readable();
+        int value = 0;
+        while (buffer.try_get(value)) {
+            ordered = ordered && value == expected;
+            ++expected;
+        }
+    }
+    producer.join();
+    close(epoll);
+
+    ASSERT_TRUE(ordered);
+}
+#endif
+
+#ifdef BUFF_HAS_COROUTINES
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+};
+
+DetachedTask Produce(ConcurrentCircularBuffer<int> &buffer, int from, int count) {
+    for (int i = from; i < from + count; i++) {
+        co_await buffer.async_put(i);
+    }
+}
+
+DetachedTask Consume(ConcurrentCircularBuffer<int> &buffer, int count, std::vector<int> &out) {
+    for (int i = 0; i < count; i++) {
+        out.push_back(co_await buffer.async_get());
+    }
+}
+
+TEST(ConcurrentCircularBufferTestSuite, CoroutineTest) {
+    ConcurrentCircularBuffer<int> buffer(4);
+    std::vector<int> out;
+
+    Consume(buffer, 100, out);
+    ASSERT_TRUE(out.empty()); // корутина ждет на пустом буфере
+
+    Produce(buffer, 0, 100);
+    ASSERT_TRUE(out.size() == 100);
+    for (int i = 0; i < 100; i++) {
+        ASSERT_TRUE(out[i] == i);
+    }
+
+    Produce(buffer, 0, 10);
+    ASSERT_TRUE(buffer.size() == 4); // 6 писателей ждут места
+    std::vector<int> rest;
+    Consume(buffer, 10, rest);
+    ASSERT_TRUE(rest.size() == 10 && rest.back() == 9);
+    ASSERT_TRUE(buffer.empty());
+}
+
+TEST(ConcurrentCircularBufferTestSuite, ExecutorTest) {
+    ConcurrentCircularBuffer<int> buffer(1);
+    std::deque<std::coroutine_handle<>> ready;
+    buffer.set_executor([&ready](std::coroutine_handle<> handle) { ready.push_back(handle); });
+
+    std::vector<int> out;
+    Consume(buffer, 50, out);
+    Produce(buffer, 0, 25);
+    Produce(buffer, 25, 25);
+
+    while (!ready.empty()) {
+        std::coroutine_handle<> handle = ready.front();
+        ready.pop_front();
+        handle.resume();
+    }
+
+    ASSERT_TRUE(out.size() == 50);
+    std::sort(out.begin(), out.end());
+    for (int i = 0; i < 50; i++) {
+        ASSERT_TRUE(out[i] == i);
+    }
+}
+
+#ifdef BUFF_HAS_EVENTFD
+TEST(ConcurrentCircularBufferTestSuite, CoroutineNotificationTest) {
+    ConcurrentCircularBuffer<int> buffer(1);
+    buffer.enable_notifications();
+    buffer.consume_writable();
+    Produce(buffer, 0, 2); // второй писатель ждет места
+
+    int value = -1;
+    ASSERT_TRUE(buffer.try_get(value) && value == 0);
+    ASSERT_TRUE(buffer.size() == 1);
+    ASSERT_FALSE(IsReadable(buffer.writable_fd())); // место сразу занял ждущий писатель
+
+    ASSERT_TRUE(buffer.try_get(value) && value == 1);
+    ASSERT_TRUE(IsReadable(buffer.writable_fd()));
+}
+#endif
+#endif
+
+TEST(CompressedCircularBufferTestSuite, RoundTripTest) {
+    CompressedCircularBuffer<int64_t, 8> buffer(1000);
+    std::vector<int64_t> values{0, -1, 5, INT64_MAX, INT64_MIN, 7, 7, 7, 100, -100, 3};
+    for (int64_t value: values) {
+        buffer.put(value);
+    }
+
+    ASSERT_TRUE(buffer.size() == values.size());
+    ASSERT_TRUE(std::vector<int64_t>(buffer.begin(), buffer.end()) == values);
+    ASSERT_TRUE(buffer.front() == 0 && buffer.back() == 3);
+
+    buffer.clear();
+    ASSERT_TRUE(buffer.empty());
+    ASSERT_TRUE(buffer.begin() == buffer.end());
+    ASSERT_TRUE(buffer.front() == 0 && buffer.back() == 0); // пустой буфер отдает T()
+}
+
+TEST(CompressedCircularBufferTestSuite, EvictionTest) {
+    CompressedCircularBuffer<int64_t, 16> buffer(100);
+    for (int64_t i = 0; i < 1000; i++) {
+        buffer.put(i);
+    }
+
+    ASSERT_TRUE(buffer.size() >= 100 && buffer.size() < 116);
+    ASSERT_TRUE(buffer.back() == 999);
+    int64_t expected = buffer.front();
+    for (int64_t value: buffer) {
+        ASSERT_TRUE(value == expected);
+        ++expected;
+    }
+    ASSERT_TRUE(expected == 1000);
+}
+
+TEST(CompressedCircularBufferTestSuite, CompressionTest) {
+    const size_t count = 100000;
+    CompressedCircularBuffer<int64_t> timestamps(count);
+    CompressedCircularBuffer<int64_t> counters(count);
+    int64_t counter = 0;
+    for (size_t i = 0; i < count; i++) {
+        timestamps.put(1700000000000000000 + int64_t(i) * 1000000000 + int64_t(i % 7));
+        counter += int64_t(i % 5);
+        counters.put(counter);
+    }
+
+    ASSERT_TRUE(timestamps.memory_bytes() * 5 < count * sizeof(int64_t));
+    ASSERT_TRUE(counters.memory_bytes() * 5 < count * sizeof(int64_t));
+
+    size_t i = 0;
+    for (int64_t value: timestamps) {
+        ASSERT_TRUE(value == 1700000000000000000 + int64_t(i) * 1000000000 + int64_t(i % 7));
+        ++i;
+    }
+    ASSERT_TRUE(i == count);
+}
+
+TEST(SnapshotCircularBufferTestSuite, SnapshotTest) {
+    SnapshotCircularBuffer<int> bufer(4);
+    ASSERT_TRUE(bufer.snapshot().empty());
+    for (int i = 0; i < 6; i++) {
+        bufer.put(i);
+    }
+    SnapshotCircularBuffer<int>::Snapshot snapshot = bufer.snapshot();
+    ASSERT_TRUE(snapshot.size() == 4 && snapshot.sequence() == 2);
+    ASSERT_TRUE(std::vector<int>(snapshot.begin(), snapshot.end()) == std::vector<int>({2, 3, 4, 5}));
+
+    const int *data = snapshot.begin();
+    bufer.put(6);
+    bufer.snapshot(snapshot);
+    ASSERT_TRUE(snapshot.begin() == data); // память снимка переиспользуется
+    ASSERT_TRUE(snapshot[0] == 3 && snapshot[3] == 6);
+
+    struct Point {
+        int16_t x, y, z;
+    };
+    SnapshotCircularBuffer<Point> points(2); // элемент из нескольких слов
+    points.put({1, 2, 3});
+    points.put({4, 5, 6});
+    points.put({7, 8, 9});
+    SnapshotCircularBuffer<Point>::Snapshot last = points.snapshot();
+    ASSERT_TRUE(last.size() == 2 && last[0].x == 4 && last[1].z == 9);
+}
+
+TEST(SnapshotCircularBufferTestSuite, ThreadsTest) {
+    const uint64_t count = 500000;
+    SnapshotCircularBuffer<uint64_t> bufer(256);
+    std::atomic<bool> done(false);
+    std::atomic<bool> consistent(true);
+
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < 2; reader++) {
+        readers.emplace_back([&] {
+            SnapshotCircularBuffer<uint64_t>::Snapshot snapshot;
+            while (!done.load()) {
+                bufer.snapshot(snapshot);
+                for (size_t i = 0; i < snapshot.size(); i++) {
+                    if (snapshot[i] != snapshot.sequence() + i) {
+                        consistent = false;
+                    }
+                }
+            }
+        });
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        bufer.put(i);
+    }
+    done = true;
+    for (std::thread &reader: readers) {
+        reader.join();
+    }
+    ASSERT_TRUE(consistent.load());
+    ASSERT_TRUE(bufer.snapshot().sequence() == count - 256);
+}
+
+TEST(ShardedCircularBufferTestSuite, RoutingTest) {
+    ShardedCircularBuffer<int> bufer(4, 8, true);
+    ASSERT_TRUE(bufer.shards() == 4 && bufer.shard_capacity() == 8);
+    ASSERT_TRUE(bufer.local_shard() < 4);
+
+    size_t shard = bufer.shard_for(std::string("key"));
+    for (int i = 0; i < 8; i++) {
+        ASSERT_TRUE(bufer.try_put_by_key(std::string("key"), i));
+    }
+    ASSERT_FALSE(bufer.try_put_by_key(std::string("key"), 8)); // шард заполнен, остальные пусты
+    ASSERT_TRUE(bufer.size(shard) == 8 && bufer.size() == 8);
+
+    int value = -1;
+    ASSERT_TRUE(bufer.try_get(shard, value) && value == 0);
+    ASSERT_FALSE(bufer.try_get((shard + 1) % 4, value));
+
+    bufer.try_put((shard + 1) % 4, 100);
+    bufer.try_put((shard + 2) % 4, 101);
+    std::vector<int> merged;
+    while (bufer.try_get_merged(value)) {
+        merged.push_back(value);
+    }
+    ASSERT_TRUE(merged == std::vector<int>({1, 2, 3, 4, 5, 6, 7, 100, 101}));
+    ASSERT_TRUE(bufer.empty());
+}
@@ -0,0 +1,58 @@
+// Собирается отдельной целью с BUFF_CACHE_LINE_LAYOUT, BUFF_ENABLE_STATS и BUFF_ENABLE_LATENCY_TRACE:
+// раскладка полей буфера по кэш-линиям писателя и читателя.
+#include <lib/CCircularBuffer.h>
+#include <gtest/gtest.h>
+#include <cstddef>
+
+using namespace buff;
+
+namespace {
+    struct LayoutProbe : CCircularBufferBase<int> {
+        using CCircularBufferBase<int>::end_index;
+        using CCircularBufferBase<int>::beg_index;
+        using CCircularBufferBase<int>::empty_;
+        using CCircularBufferBase<int>::stats_;
+        using CCircularBufferBase<int>::trace_;
+    };
+
+    constexpr size_t Line(size_t offset) {
+        return offset / kCacheLineSize;
+    }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+    constexpr size_t kEnd = offsetof(LayoutProbe, end_index);
+    constexpr size_t kBeg = offsetof(LayoutProbe, beg_index);
+    constexpr size_t kEmpty = offsetof(LayoutProbe, empty_);
+    constexpr size_t kStats = offsetof(LayoutProbe, stats_);
+    constexpr size_t kTrace = offsetof(LayoutProbe, trace_);
+#pragma GCC diagnostic pop
+
+    static_assert(Line(kEnd) != Line(kBeg), "indices must be on different lines");
+    static_assert(Line(kEmpty) == Line(kBeg), "empty_ belongs to the consumer line");
+    static_assert(kStats > kEnd and kTrace > kStats and kTrace + sizeof(LatencyTrace) <= kBeg,
+                  "stats_ and trace_ must stay off the consumer line");
+    // счетчики и гистограмма читателя выровнены внутри stats_ и trace_ на свои линии
+    static_assert(alignof(BufferStats) == kCacheLineSize and alignof(LatencyTrace) == kCacheLineSize,
+                  "consumer-written parts of stats_ and trace_ must start their own lines");
+}
+
+TEST(CacheLineLayoutTestSuite, PutGetTest) {
+    CCircularBuffer<int> bufer(4);
+    ASSERT_TRUE(bufer.empty());
+    for (int i = 0; i < 6; i++) {
+        bufer.put(i);
+    }
+    ASSERT_TRUE(bufer.size() == 4 && bufer.front() == 2);
+    ASSERT_TRUE(bufer.get() == 2);
+    while (!bufer.empty()) {
+        bufer.get();
+    }
+    bufer.put(7);
+    ASSERT_FALSE(bufer.empty());
+    ASSERT_TRUE(bufer.get() == 7 && bufer.empty());
+
+    BufferStatsSnapshot stats = bufer.stats();
+    ASSERT_TRUE(stats.puts == 7 && stats.gets == 5 && stats.overwrites == 2);
+    ASSERT_TRUE(bufer.latency().count() == 5);
+}
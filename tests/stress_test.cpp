@@ -0,0 +1,365 @@
+#include <lib/BroadcastRing.h>
+#include <lib/ConcurrentCircularBuffer.h>
+#include <lib/LatencyHistogram.h>
+#include <lib/ShardedCircularBuffer.h>
+#include <lib/SnapshotCircularBuffer.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace buff;
+
+// Нагрузочные прогоны параллельных буферов: несколько писателей и читателей, проверка номеров сообщений
+// на потери, дубли и перестановки, вывод пропускной способности и перцентилей задержки.
+// Число сообщений на писателя задается переменной окружения BUFF_STRESS_MESSAGES.
+
+namespace {
+    struct Message {
+        uint64_t producer = 0;
+        uint64_t seq = 0;
+        uint64_t stamp = 0;
+    };
+
+    uint64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t MessagesPerProducer() {
+        const char *messages = std::getenv("BUFF_STRESS_MESSAGES");
+        if (messages != nullptr and std::strtoull(messages, nullptr, 10) > 0) {
+            return std::strtoull(messages, nullptr, 10);
+        }
+        return 100000;
+    }
+
+    size_t Threads() {
+        return std::max<size_t>(2, std::min<size_t>(4, std::thread::hardware_concurrency()));
+    }
+
+    // Каждый номер каждого писателя должен прийти ровно copies раз, а каждый читатель должен видеть
+    // номера одного писателя по возрастанию
+    class SequenceChecker {
+    public:
+        SequenceChecker(size_t producers, size_t consumers, uint64_t messages, uint64_t copies = 1)
+                : producers_(producers), messages_(messages), copies_(copies), seen_(producers * messages),
+                  next_(consumers * producers, 0) {}
+
+        void on_message(size_t consumer, const Message &message) {
+            latency_.record(Now() - message.stamp);
+            if (message.producer >= producers_ or message.seq >= messages_) {
+                corrupted_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            seen_[message.producer * messages_ + message.seq].fetch_add(1, std::memory_order_relaxed);
+            uint64_t &next = next_[consumer * producers_ + message.producer];
+            if (message.seq < next) {
+                reordered_.fetch_add(1, std::memory_order_relaxed);
+            }
+            next = message.seq + 1;
+        }
+
+        uint64_t lost() const {
+            uint64_t ret = 0;
+            for (const std::atomic<uint64_t> &seen: seen_) {
+                ret += seen.load() < copies_ ? copies_ - seen.load() : 0;
+            }
+            return ret;
+        }
+
+        uint64_t duplicated() const {
+            uint64_t ret = 0;
+            for (const std::atomic<uint64_t> &seen: seen_) {
+                ret += seen.load() > copies_ ? seen.load() - copies_ : 0;
+            }
+            return ret;
+        }
+
+        uint64_t reordered() const {
+            return reordered_.load();
+        }
+
+        uint64_t corrupted() const {
+            return corrupted_.load();
+        }
+
+        const LatencyHistogram &latency() const {
+            return latency_;
+        }
+
+    private:
+        size_t producers_;
+        uint64_t messages_;
+        uint64_t copies_;
+        std::vector<std::atomic<uint64_t>> seen_;
+        std::vector<uint64_t> next_;
+        std::atomic<uint64_t> reordered_{0};
+        std::atomic<uint64_t> corrupted_{0};
+        LatencyHistogram latency_;
+    };
+
+    void Report(const char *name, uint64_t messages, std::chrono::steady_clock::time_point start,
+                const LatencyHistogram &latency) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << name << ": " << messages << " msgs, " << static_cast<uint64_t>(messages / seconds)
+                  << " msgs/s, latency ns p50 " << latency.value_at_percentile(50)
+                  << " p99 " << latency.value_at_percentile(99)
+                  << " p99.9 " << latency.value_at_percentile(99.9)
+                  << " max " << latency.max() << std::endl;
+    }
+
+    void ExpectClean(const SequenceChecker &checker) {
+        EXPECT_EQ(checker.lost(), 0u);
+        EXPECT_EQ(checker.duplicated(), 0u);
+        EXPECT_EQ(checker.reordered(), 0u);
+        EXPECT_EQ(checker.corrupted(), 0u);
+    }
+}
+
+TEST(StressTestSuite, ConcurrentCircularBufferTest) {
+    const size_t producers = Threads();
+    const size_t consumers = Threads();
+    const uint64_t messages = MessagesPerProducer();
+    const uint64_t total = producers * messages;
+    ConcurrentCircularBuffer<Message> bufer(1024);
+    SequenceChecker checker(producers, consumers, messages);
+    std::atomic<uint64_t> received(0);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t consumer = 0; consumer < consumers; consumer++) {
+        threads.emplace_back([&, consumer] {
+            Message message;
+            while (received.load(std::memory_order_relaxed) < total) {
+                if (!bufer.try_get(message)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                checker.on_message(consumer, message);
+                received.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (size_t producer = 0; producer < producers; producer++) {
+        threads.emplace_back([&, producer] {
+            for (uint64_t seq = 0; seq < messages;) {
+                if (bufer.try_put(Message{producer, seq, Now()})) {
+                    ++seq;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    Report("ConcurrentCircularBuffer", total, start, checker.latency());
+    ExpectClean(checker);
+    ASSERT_TRUE(bufer.empty());
+}
+
+TEST(StressTestSuite, BroadcastRingTest) {
+    const size_t consumers = Threads();
+    const uint64_t messages = MessagesPerProducer();
+    BroadcastRing<Message> ring(1024, consumers);
+    SequenceChecker checker(1, consumers, messages, consumers);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t consumer = 0; consumer < consumers; consumer++) {
+        threads.emplace_back([&, consumer] {
+            Message message;
+            for (uint64_t taken = 0; taken < messages;) {
+                if (!ring.try_get(consumer, message)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                checker.on_message(consumer, message);
+                ++taken;
+            }
+        });
+    }
+    for (uint64_t seq = 0; seq < messages;) {
+        if (ring.try_put(Message{0, seq, Now()})) {
+            ++seq;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    Report("BroadcastRing", messages * consumers, start, checker.latency());
+    ExpectClean(checker);
+}
+
+TEST(StressTestSuite, ShardedCircularBufferTest) {
+    const size_t producers = Threads();
+    const size_t consumers = Threads();
+    const uint64_t messages = MessagesPerProducer();
+    const uint64_t total = producers * messages;
+    ShardedCircularBuffer<Message> bufer(producers, 256, true);
+    SequenceChecker checker(producers, consumers, messages);
+    std::atomic<uint64_t> received(0);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t consumer = 0; consumer < consumers; consumer++) {
+        threads.emplace_back([&, consumer] {
+            Message message;
+            while (received.load(std::memory_order_relaxed) < total) {
+                if (!bufer.try_get_merged(message)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                checker.on_message(consumer, message);
+                received.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (size_t producer = 0; producer < producers; producer++) {
+        threads.emplace_back([&, producer] {
+            // все сообщения писателя в одном шарде, поэтому их порядок сохраняется
+            for (uint64_t seq = 0; seq < messages;) {
+                if (bufer.try_put_by_key(producer, Message{producer, seq, Now()})) {
+                    ++seq;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    Report("ShardedCircularBuffer", total, start, checker.latency());
+    ExpectClean(checker);
+    ASSERT_TRUE(bufer.empty());
+}
+
+// Пропускная способность put + get при росте числа потоков: шарды (по номеру потока и по ядру)
+// против одного общего буфера
+TEST(StressTestSuite, ShardedScalingTest) {
+    const uint64_t count = MessagesPerProducer();
+    size_t max_threads = std::max<size_t>(2, std::min<size_t>(8, std::thread::hardware_concurrency()));
+
+    auto measure = [&](size_t threads, auto &&put, auto &&get) {
+        std::vector<uint64_t> sums(threads, 0);
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                uint64_t value = 0;
+                for (uint64_t i = 1; i <= count; i++) {
+                    while (!put(t, i)) {
+                        std::this_thread::yield();
+                    }
+                    if (get(t, value)) {
+                        sums[t] += value;
+                    }
+                }
+                while (get(t, value)) {
+                    sums[t] += value;
+                }
+            });
+        }
+        for (std::thread &worker: workers) {
+            worker.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        EXPECT_EQ(std::accumulate(sums.begin(), sums.end(), uint64_t(0)), threads * count * (count + 1) / 2);
+        return threads * count / seconds;
+    };
+
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        ShardedCircularBuffer<uint64_t> sharded(threads, 1024);
+        double sharded_rate = measure(threads, [&](size_t t, uint64_t v) {
+            return sharded.try_put(t, v);
+        }, [&](size_t t, uint64_t &v) {
+            return sharded.try_get(t, v);
+        });
+
+        // поток может переехать на другое ядро, поэтому читатель обходит все шарды, начиная со своего
+        ShardedCircularBuffer<uint64_t> by_cpu(threads, 1024);
+        double by_cpu_rate = measure(threads, [&](size_t, uint64_t v) {
+            return by_cpu.try_put(v);
+        }, [&](size_t, uint64_t &v) {
+            size_t local = by_cpu.local_shard();
+            for (size_t i = 0; i < by_cpu.shards(); i++) {
+                if (by_cpu.try_get((local + i) % by_cpu.shards(), v)) {
+                    return true;
+                }
+            }
+            return false;
+        });
+
+        ConcurrentCircularBuffer<uint64_t> single(1024);
+        double single_rate = measure(threads, [&](size_t, uint64_t v) {
+            return single.try_put(v);
+        }, [&](size_t, uint64_t &v) {
+            return single.try_get(v);
+        });
+        std::cout << threads << " threads: sharded " << uint64_t(sharded_rate) << " msgs/s, sharded by cpu "
+                  << uint64_t(by_cpu_rate) << " msgs/s, single " << uint64_t(single_rate) << " msgs/s" << std::endl;
+    }
+}
+
+TEST(StressTestSuite, SnapshotCircularBufferTest) {
+    const size_t readers = Threads();
+    const uint64_t messages = MessagesPerProducer();
+    SnapshotCircularBuffer<uint64_t> bufer(1024);
+    LatencyHistogram snapshot_latency;
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> broken(0);
+    std::atomic<uint64_t> snapshots(0);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t reader = 0; reader < readers; reader++) {
+        threads.emplace_back([&] {
+            SnapshotCircularBuffer<uint64_t>::Snapshot snapshot;
+            uint64_t last_sequence = 0;
+            while (!done.load()) {
+                uint64_t begin = Now();
+                bufer.snapshot(snapshot);
+                snapshot_latency.record(Now() - begin);
+                snapshots.fetch_add(1, std::memory_order_relaxed);
+                if (snapshot.sequence() < last_sequence) {
+                    broken.fetch_add(1);
+                }
+                last_sequence = snapshot.sequence();
+                for (size_t i = 0; i < snapshot.size(); i++) {
+                    if (snapshot[i] != snapshot.sequence() + i) {
+                        broken.fetch_add(1);
+                        break;
+                    }
+                }
+            }
+        });
+    }
+    for (uint64_t seq = 0; seq < messages; seq++) {
+        bufer.put(seq);
+        if (seq % 1024 == 0) {
+            std::this_thread::yield(); // дать читателям снять снимки и на одном ядре
+        }
+    }
+    while (snapshots.load() < readers) {
+        std::this_thread::yield();
+    }
+    done = true;
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    // задержка здесь - время снятия одного снимка
+    Report("SnapshotCircularBuffer", messages, start, snapshot_latency);
+    ASSERT_EQ(broken.load(), 0u);
+    SnapshotCircularBuffer<uint64_t>::Snapshot last = bufer.snapshot();
+    ASSERT_TRUE(last.size() == std::min<uint64_t>(messages, 1024) && last[last.size() - 1] == messages - 1);
+}